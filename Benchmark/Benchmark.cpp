@@ -0,0 +1,269 @@
+﻿# include <Siv3D.hpp>
+# include "../BunchoUI.hpp"
+
+//ウィンドウを出さずに実行する
+SIV3D_SET(EngineOption::Renderer::Headless)
+
+using namespace BunchoUI;
+
+namespace
+{
+	constexpr size_t Iterations = 100;
+
+	/// @brief 計測するUIの木
+	struct Scenario
+	{
+		String name;
+		std::function<std::shared_ptr<UIElement>()> create;
+	};
+
+	/// @brief 深く入れ子にしたUI
+	std::shared_ptr<UIElement> DeepNesting(size_t depth)
+	{
+		std::shared_ptr<UIElement> ui = TextUI::Create({ .text = U"leaf" });
+		for (size_t i = 0; i < depth; ++i)
+		{
+			if (i % 2)
+			{
+				ui = Row::Create({ .margine = 1,.children{ ui } });
+			}
+			else
+			{
+				ui = RectPanel::Create({ .padding = 1,.child = Column::Create({.children{ ui } }) });
+			}
+		}
+		return ui;
+	}
+
+	/// @brief 横にたくさん並べたUI
+	std::shared_ptr<UIElement> WideRow(size_t count)
+	{
+		auto row = Row::Create({});
+		for (size_t i = 0; i < count; ++i)
+		{
+			row->addChild(RectUI::Create({ .size = SizeF{ 4,20 } }));
+		}
+		return row;
+	}
+
+	/// @brief flexを多用したUI
+	std::shared_ptr<UIElement> FlexHeavy(size_t rows, size_t columns)
+	{
+		auto column = Column::Create({});
+		for (size_t y = 0; y < rows; ++y)
+		{
+			auto row = Row::Create({ .flex = 1.0 });
+			for (size_t x = 0; x < columns; ++x)
+			{
+				row->addChild(RectUI::Create({ .flex = (double)(x % 3 + 1),.relative = Relative::Stretch() }));
+			}
+			column->addChild(row);
+		}
+		return column;
+	}
+
+	/// @brief 文字をたくさん表示するUI
+	std::shared_ptr<UIElement> TextHeavy(size_t count)
+	{
+		auto column = Column::Create({});
+		for (size_t i = 0; i < count; ++i)
+		{
+			column->addChild(TextUI::Create({ .text = U"とってもおいしいくだもの {}"_fmt(i) }));
+		}
+		return column;
+	}
+
+	/// @brief 長いリストをスクロールするUI
+	std::shared_ptr<UIElement> ScrollHeavy(size_t count)
+	{
+		auto column = Column::Create({});
+		for (size_t i = 0; i < count; ++i)
+		{
+			column->addChild(SimpleButton::Create
+			({
+				.margine = 2,
+				.width = 250,
+				.child = Row::Create
+				({
+					.children
+					{
+						RectUI::Create({ .size = SizeF{ 40,40 } }),
+						TextUI::Create({ .text = U"item {}"_fmt(i),.flex = 1.0 })
+					}
+				})
+			}));
+		}
+		return SimpleScrollbar::Create({ .child = column });
+	}
+
+	/// @brief 木に含まれるUIの数を数える
+	size_t CountNodes(UIElement* element)
+	{
+		size_t count = 1;
+		element->forEachChild([&](UIElement* child) { count += CountNodes(child); });
+		return count;
+	}
+
+	/// @brief 木のすべてのUIの大きさを計算し直させる
+	void InvalidateAll(UIElement* element)
+	{
+		element->forEachChild([&](UIElement* child) { InvalidateAll(child); });
+		element->changeSize();
+	}
+
+	/// @brief 木を再帰でたどって、指定した座標にある一番手前のUIを探す
+	UIElement* HitTestRecursive(UIElement* element, const Vec2& pos)
+	{
+		UIElement* result = nullptr;
+		element->forEachChild([&](UIElement* child)
+			{
+				if (UIElement* hit = HitTestRecursive(child, pos))
+				{
+					result = hit;
+				}
+			});
+
+		if (result)
+		{
+			return result;
+		}
+
+		return element->getMargineRect().contains(pos) ? element : nullptr;
+	}
+
+	/// @brief UIManagerで1フレーム(更新と描画)を行い、たどったUIの数を数える
+	/// @return 2フレーム目の統計(1フレーム目は最初のレイアウトを含む)
+	/// @remark BUNCHOUI_ENABLE_STATSを定義していないときは常に0
+	FrameStats CountVisits(const std::shared_ptr<UIElement>& root, const RectF& area)
+	{
+		UIManager manager{ area };
+		manager.setChildren({ root });
+
+		for (int32 i = 0; i < 2; ++i)
+		{
+			manager.update(area);
+			manager.draw();
+		}
+
+		//統計は次のupdateで締められる
+		manager.update(area);
+		const FrameStats stats = manager.getFrameStats();
+
+		manager.removeChild(root);
+		return stats;
+	}
+
+	/// @brief 当たり判定を調べる座標
+	Array<Vec2> HitTestProbes(const RectF& area)
+	{
+		Array<Vec2> probes;
+		for (int32 y = 0; y < 8; ++y)
+		{
+			for (int32 x = 0; x < 8; ++x)
+			{
+				probes << area.pos + Vec2{ (x + 0.5) * area.w / 8,(y + 0.5) * area.h / 8 };
+			}
+		}
+		return probes;
+	}
+
+	void Run(const Scenario& scenario, const RectF& area)
+	{
+		NodePool::ResetStats();
+		Stopwatch stopwatch{ StartImmediately::Yes };
+		auto root = StackUI::Create({ .children{ scenario.create() } });
+		const double createTime = stopwatch.msF();
+		const size_t allocations = NodePool::GetStats().allocations;
+		const size_t nodes = CountNodes(root.get());
+
+		root->build(area);
+
+		//全体の再レイアウト
+		UIElement::ResetMeasureStats();
+		stopwatch.restart();
+		for (size_t i = 0; i < Iterations; ++i)
+		{
+			InvalidateAll(root.get());
+			root->build(area);
+		}
+		const double layoutTime = stopwatch.msF() / Iterations;
+		const UIElement::MeasureStats measureStats = UIElement::GetMeasureStats();
+
+		//更新
+		stopwatch.restart();
+		for (size_t i = 0; i < Iterations; ++i)
+		{
+			CursorSystem::SetCaptureOneFrame(false);
+			root->update();
+		}
+		const double updateTime = stopwatch.msF() / Iterations;
+
+		//描画
+		stopwatch.restart();
+		for (size_t i = 0; i < Iterations; ++i)
+		{
+			root->draw(area);
+		}
+		const double drawTime = stopwatch.msF() / Iterations;
+
+		//当たり判定(木をたどる場合と並べた配列を調べる場合)
+		const Array<Vec2> probes = HitTestProbes(area);
+		size_t found = 0;
+		stopwatch.restart();
+		for (size_t i = 0; i < Iterations; ++i)
+		{
+			for (const auto& pos : probes)
+			{
+				found += (HitTestRecursive(root.get(), pos) != nullptr);
+			}
+		}
+		const double treeHitTestTime = stopwatch.msF() / Iterations;
+
+		FlatTree flatTree;
+		stopwatch.restart();
+		for (size_t i = 0; i < Iterations; ++i)
+		{
+			flatTree.rebuild(*root);
+		}
+		const double flattenTime = stopwatch.msF() / Iterations;
+
+		stopwatch.restart();
+		for (size_t i = 0; i < Iterations; ++i)
+		{
+			for (const auto& pos : probes)
+			{
+				found += (flatTree.hitTest(pos) != nullptr);
+			}
+		}
+		const double flatHitTestTime = stopwatch.msF() / Iterations;
+
+		const FrameStats visits = CountVisits(root, area);
+
+		Console << U"{:<14} nodes:{:>6} alloc:{:>6} create:{:>8.3f}ms layout:{:>8.3f}ms update:{:>8.3f}ms draw:{:>8.3f}ms measure(hit/miss):{}/{}"_fmt(
+			scenario.name, nodes, allocations, createTime, layoutTime, updateTime, drawTime,
+			measureStats.hits / Iterations, measureStats.misses / Iterations);
+		Console << U"{:<14} visited per frame: update:{:>6} (skipped:{:>6}) draw:{:>6}"_fmt(
+			U"", visits.updateVisits, visits.updateSkips, visits.drawVisits);
+		Console << U"{:<14} hit-test x{}: tree:{:>8.3f}ms flat:{:>8.3f}ms (flatten:{:>8.3f}ms, found:{})"_fmt(
+			U"", probes.size(), treeHitTestTime, flatHitTestTime, flattenTime, found / (Iterations * 2));
+	}
+}
+
+void Main()
+{
+	const RectF area{ 0,0,1280,720 };
+
+	const Array<Scenario> scenarios
+	{
+		{ U"deep-nesting",[] { return DeepNesting(200); } },
+		{ U"wide-row",[] { return WideRow(5000); } },
+		{ U"flex-heavy",[] { return FlexHeavy(50,50); } },
+		{ U"text-heavy",[] { return TextHeavy(2000); } },
+		{ U"scroll-heavy",[] { return ScrollHeavy(2000); } },
+	};
+
+	for (const auto& scenario : scenarios)
+	{
+		Run(scenario, area);
+	}
+}
@@ -1,5 +1,17 @@
 ﻿#include"BunchoUI.hpp"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	define BUNCHOUI_HIT_TEST_SSE2
+#	include <emmintrin.h>
+#endif
+
+//統計はこのファイルの中だけで数える(ヘッダーのインライン関数では数えない)
+#ifdef BUNCHOUI_ENABLE_STATS
+#	define BUNCHOUI_COUNT_STATS(counter) (++BunchoUI::detail::CurrentFrameStats().counter)
+#else
+#	define BUNCHOUI_COUNT_STATS(counter) ((void)0)
+#endif
+
 namespace BunchoUI
 {
 	namespace
@@ -13,6 +25,314 @@ namespace BunchoUI
 		bool g_wheelHCapturedOneFrame = false;
 
 		String g_handStyleName;
+
+		/// @brief 同じ大きさのメモリをまとめて管理するプール
+		struct SizeClassPool
+		{
+			void* freeList = nullptr;
+			Array<void*> chunks;
+			size_t liveBlocks = 0;
+		};
+
+		constexpr size_t PoolGranularity = 32;
+
+		constexpr size_t PoolMaxSize = 1024;
+
+		constexpr size_t BlocksPerChunk = 64;
+
+		SizeClassPool g_pools[PoolMaxSize / PoolGranularity];
+
+		bool g_poolEnabled = true;
+
+		NodePool::Stats g_poolStats;
+
+		UIElement::MeasureStats g_measureStats;
+
+		uint64 g_hitTestIndexCount = 0;
+
+		/// @brief 今のフレームで使っている当たり判定の格子の番号(0なら格子を使わない)
+		uint64 g_activeHitTestIndex = 0;
+
+		uint64 g_hitTestFrame = 0;
+
+		/// @brief 格子に登録されたUIが破棄された回数
+		uint64 g_hitTestIndexedDestroyed = 0;
+
+		FrameStats g_frameStats;
+
+		/// @brief 記録中のDrawList(nullptrならすぐに描画する)
+		DrawList* g_drawList = nullptr;
+
+		/// @brief 再生に使う前のフレームのDrawList(nullptrなら再生しない)
+		const DrawList* g_previousDrawList = nullptr;
+
+		/// @brief 記録中のUIManagerの、描画を記録した回数
+		uint64 g_drawFrame = 0;
+
+		/// @brief onDrawを実行した回数(UIの記録がどのonDrawの中で行われたかを区別する)
+		uint64 g_drawRunCount = 0;
+
+		RepaintBoundary::CacheStats g_repaintCacheStats;
+
+		/// @brief RepaintBoundaryのテクスチャの1画素あたりの大きさ(4サンプルと、まとめた後のテクスチャの分)
+		constexpr size_t LayerBytesPerPixel = 4 * (4 + 1);
+
+		size_t g_transactionDepth = 0;
+
+		/// @brief トランザクションの終わりに親へ通知するUI
+		Array<UIElement*> g_deferredElements;
+
+		/// @brief 生きているUIManager(UIが破棄されるときに、イベントの対象から外す)
+		Array<UIManager*> g_managers;
+
+		/// @brief 更新中のUIManager(カーソルが触れているUIと、触れた・離れたイベントを記録する先)
+		UIManager* g_updatingManager = nullptr;
+
+		/// @brief 更新中のUIManagerに渡された入力(nullptrなら実際の入力を使う)
+		const MouseInput* g_updatingInput = nullptr;
+
+		/// @brief 更新中のUIManagerの、前の更新からのカーソルの移動量
+		Vec2 g_updatingInputDelta{ 0,0 };
+
+		/// @brief UIが読むカーソルの移動量
+		[[nodiscard]]
+		Vec2 CurrentMouseDelta()
+		{
+			return g_updatingInput ? g_updatingInputDelta : Cursor::DeltaF();
+		}
+
+		/// @brief イベントを送っている途中の、対象から根までのUI
+		Array<UIElement*> g_dispatchPath;
+
+		/// @brief clickableがtrueのUIだけが受け取るイベントか
+		[[nodiscard]]
+		constexpr bool IsButtonEvent(const UIEventType type)noexcept
+		{
+			return type == UIEventType::Click || type == UIEventType::Press || type == UIEventType::Release;
+		}
+
+		/// @brief 2つのUIの、一番深い共通の祖先(自身を含む)を探す
+		[[nodiscard]]
+		UIElement* CommonAncestor(UIElement* a, UIElement* b)noexcept
+		{
+			for (; a; a = a->getParent())
+			{
+				for (UIElement* e = b; e; e = e->getParent())
+				{
+					if (e == a)
+					{
+						return a;
+					}
+				}
+			}
+
+			return nullptr;
+		}
+
+		/// @brief 更新中の、スクロールなどで見えている範囲(noneなら全体が見えている)
+		Optional<RectF> g_updateArea;
+
+		/// @brief スコープの間、更新する範囲を狭める
+		class ScopedUpdateArea
+		{
+		public:
+
+			/// @param area 見えている範囲(外側の範囲と同じ座標系)
+			/// @param offset 子供の座標系への移動量
+			ScopedUpdateArea(const RectF& area, const Vec2& offset)
+				: m_previous{ g_updateArea }
+			{
+				const RectF visible = g_updateArea ? area.getOverlap(*g_updateArea) : area;
+				g_updateArea = visible.movedBy(offset);
+			}
+
+			~ScopedUpdateArea()
+			{
+				g_updateArea = m_previous;
+			}
+
+			ScopedUpdateArea(const ScopedUpdateArea&) = delete;
+
+			ScopedUpdateArea& operator=(const ScopedUpdateArea&) = delete;
+
+		private:
+
+			Optional<RectF> m_previous;
+		};
+
+		[[nodiscard]]
+		RectF BoundingRect(const RectF& a, const RectF& b)
+		{
+			const double left = Min(a.x, b.x);
+			const double top = Min(a.y, b.y);
+			return RectF{ left,top,Max(a.rightX(),b.rightX()) - left,Max(a.bottomY(),b.bottomY()) - top };
+		}
+
+		[[nodiscard]]
+		Rect OverlapRect(const Rect& a, const Rect& b)
+		{
+			const int32 left = Max(a.x, b.x);
+			const int32 top = Max(a.y, b.y);
+			return Rect{ left,top,Max(Min(a.x + a.w,b.x + b.w) - left,0),Max(Min(a.y + a.h,b.y + b.h) - top,0) };
+		}
+
+		/// @brief 描き直す範囲を、画面内の整数の座標に直してまとめる
+		/// @param rects 描き直す範囲
+		/// @param area 画面の範囲
+		/// @param maxCount まとめた後の数の上限
+		void MergeDamageRects(Array<RectF>& rects, const RectF& area, size_t maxCount)
+		{
+			Array<RectF> merged;
+			for (const RectF& rect : rects)
+			{
+				const RectF overlap = rect.getOverlap(area);
+				if (overlap.w <= 0 || overlap.h <= 0)
+				{
+					continue;
+				}
+
+				//切り抜きは整数の座標で行うので、外側に広げておく
+				const double left = std::floor(overlap.x);
+				const double top = std::floor(overlap.y);
+				merged << RectF{ left,top,std::ceil(overlap.rightX()) - left,std::ceil(overlap.bottomY()) - top };
+			}
+
+			//重なる範囲は1つにまとめる(まとめた範囲が別の範囲と重なることがあるので、変わらなくなるまで繰り返す)
+			for (bool changed = true; changed;)
+			{
+				changed = false;
+				for (size_t i = 0; i < merged.size() && not changed; ++i)
+				{
+					for (size_t k = i + 1; k < merged.size(); ++k)
+					{
+						if (merged[i].intersects(merged[k]))
+						{
+							merged[i] = BoundingRect(merged[i], merged[k]);
+							merged.remove_at(k);
+							changed = true;
+							break;
+						}
+					}
+				}
+			}
+
+			//多すぎると描く回数が増えるので、全体を囲む1つにする
+			if (maxCount < merged.size())
+			{
+				RectF all = merged.front();
+				for (const RectF& rect : merged)
+				{
+					all = BoundingRect(all, rect);
+				}
+				merged = { all };
+			}
+
+			rects = std::move(merged);
+		}
+	}
+
+	//-----------------------------------------------
+	//  NodePool
+	//-----------------------------------------------
+
+	void NodePool::SetEnabled(bool enabled)
+	{
+		g_poolEnabled = enabled;
+	}
+
+	bool NodePool::IsEnabled()
+	{
+		return g_poolEnabled;
+	}
+
+	void* NodePool::Allocate(size_t size, bool pooled)
+	{
+		++g_poolStats.allocations;
+		++g_poolStats.liveNodes;
+
+		if (not pooled || size == 0 || PoolMaxSize < size)
+		{
+			++g_poolStats.heapAllocations;
+			return ::operator new(size);
+		}
+
+		const size_t classIndex = (size - 1) / PoolGranularity;
+		SizeClassPool& pool = g_pools[classIndex];
+
+		if (not pool.freeList)
+		{
+			//兄弟のUIが近くに並ぶように、まとめて確保する
+			const size_t blockSize = (classIndex + 1) * PoolGranularity;
+			char* chunk = static_cast<char*>(::operator new(blockSize * BlocksPerChunk));
+			pool.chunks << chunk;
+
+			for (size_t i = 0; i < BlocksPerChunk; ++i)
+			{
+				void* block = chunk + blockSize * (BlocksPerChunk - 1 - i);
+				*static_cast<void**>(block) = pool.freeList;
+				pool.freeList = block;
+			}
+
+			++g_poolStats.chunks;
+			g_poolStats.reservedBytes += blockSize * BlocksPerChunk;
+		}
+
+		void* block = pool.freeList;
+		pool.freeList = *static_cast<void**>(block);
+		++pool.liveBlocks;
+		return block;
+	}
+
+	void NodePool::Deallocate(void* p, size_t size, bool pooled)
+	{
+		++g_poolStats.deallocations;
+		--g_poolStats.liveNodes;
+
+		if (not pooled || size == 0 || PoolMaxSize < size)
+		{
+			::operator delete(p);
+			return;
+		}
+
+		SizeClassPool& pool = g_pools[(size - 1) / PoolGranularity];
+		*static_cast<void**>(p) = pool.freeList;
+		pool.freeList = p;
+		--pool.liveBlocks;
+	}
+
+	void NodePool::TrimIdle()
+	{
+		for (size_t classIndex = 0; classIndex < std::size(g_pools); ++classIndex)
+		{
+			SizeClassPool& pool = g_pools[classIndex];
+
+			if (pool.liveBlocks)
+			{
+				continue;
+			}
+
+			for (void* chunk : pool.chunks)
+			{
+				::operator delete(chunk);
+			}
+
+			g_poolStats.chunks -= pool.chunks.size();
+			g_poolStats.reservedBytes -= pool.chunks.size() * (classIndex + 1) * PoolGranularity * BlocksPerChunk;
+			pool.chunks.clear();
+			pool.freeList = nullptr;
+		}
+	}
+
+	NodePool::Stats NodePool::GetStats()
+	{
+		return g_poolStats;
+	}
+
+	void NodePool::ResetStats()
+	{
+		g_poolStats.allocations = 0;
+		g_poolStats.deallocations = 0;
+		g_poolStats.heapAllocations = 0;
 	}
 
 	//-----------------------------------------------
@@ -71,797 +391,3317 @@ namespace BunchoUI
 	}
 
 	//-----------------------------------------------
-	//  UIElement
+	//  DrawList
 	//-----------------------------------------------
 
-	UIElement::~UIElement()
+	void DrawList::addRect(const RectF& rect, const ColorF& color)
 	{
-		if (m_hasMouseCapture)
-		{
-			CursorSystem::SetCapture(false);
-		}
+		m_commands << DrawCommand{ .type = DrawCommandType::Rect,.rect = rect,.color = color };
 	}
 
-	void UIElement::update()
+	void DrawList::addRectFrame(const RectF& rect, double thickness, const ColorF& color)
 	{
-		m_isAvailableCursor = (not CursorSystem::IsCaptured()) || hasMouseCapture();
+		m_commands << DrawCommand{ .type = DrawCommandType::RectFrame,.rect = rect,.value = thickness,.color = color };
+	}
 
-		m_mouseOvered = m_isAvailableCursor && onMouseOver();
+	void DrawList::addRoundRect(const RoundRect& roundRect, const ColorF& color)
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::RoundRect,.rect = roundRect.rect,.value = roundRect.r,.color = color };
+	}
 
-		if (m_mouseOvered && clickable)
-		{
-			CursorSystem::RequestHandStyle();
-		}
+	void DrawList::addCircle(const Circle& circle, const ColorF& color)
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::Circle,.rect = RectF{ circle.x,circle.y,circle.r,circle.r },.color = color };
+	}
 
-		onUpdate();
+	void DrawList::addLine(const Line& line, double thickness, const ColorF& color)
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::Line,.rect = RectF{ line.begin,line.end },.value = thickness,.color = color };
+	}
 
-		if (m_mouseOvered)
+	void DrawList::addText(const DrawableText& text, const TextStyle& textStyle, double fontSize, const RectF& rect, const ColorF& color)
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::Text,.rect = rect,.value = fontSize,.color = color,.resource = static_cast<uint32>(m_texts.size()) };
+		m_texts << TextRun{ text,textStyle };
+	}
+
+	void DrawList::addTextAt(const DrawableText& text, const TextStyle& textStyle, double fontSize, const Vec2& pos, const ColorF& color)
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::TextAt,.rect = RectF{ pos,0,0 },.value = fontSize,.color = color,.resource = static_cast<uint32>(m_texts.size()) };
+		m_texts << TextRun{ text,textStyle };
+	}
+
+	void DrawList::addTexture(const TextureRegion& texture, const Vec2& center, const ColorF& color)
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::Texture,.rect = RectF{ center,0,0 },.color = color,.resource = static_cast<uint32>(m_textures.size()) };
+		m_textures << texture;
+	}
+
+	void DrawList::addPremultipliedTexture(const TextureRegion& texture, const Vec2& center, const ColorF& color)
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::PremultipliedTexture,.rect = RectF{ center,0,0 },.color = color,.resource = static_cast<uint32>(m_textures.size()) };
+		m_textures << texture;
+	}
+
+	void DrawList::pushClip(const RectF& rect)
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::PushClip,.rect = rect };
+	}
+
+	void DrawList::popClip()
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::PopClip };
+	}
+
+	void DrawList::pushTransform(const Mat3x2& transform)
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::PushTransform,.resource = static_cast<uint32>(m_transforms.size()) };
+		m_transforms << transform;
+	}
+
+	void DrawList::popTransform()
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::PopTransform };
+	}
+
+	void DrawList::pushColorMul(const ColorF& color)
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::PushColorMul,.color = color };
+	}
+
+	void DrawList::popColorMul()
+	{
+		m_commands << DrawCommand{ .type = DrawCommandType::PopColorMul };
+	}
+
+	void DrawList::append(const DrawList& other)
+	{
+		append(other, 0, other.size());
+	}
+
+	void DrawList::append(const DrawList& other, size_t begin, size_t end)
+	{
+		m_commands.reserve(m_commands.size() + (end - begin));
+		for (size_t i = begin; i < end; ++i)
 		{
-			CursorSystem::SetCaptureOneFrame(true);
+			DrawCommand command = other.m_commands[i];
+			switch (command.type)
+			{
+			case DrawCommandType::Text:
+			case DrawCommandType::TextAt:
+				m_texts << other.m_texts[command.resource];
+				command.resource = static_cast<uint32>(m_texts.size() - 1);
+				break;
+			case DrawCommandType::Texture:
+			case DrawCommandType::PremultipliedTexture:
+				m_textures << other.m_textures[command.resource];
+				command.resource = static_cast<uint32>(m_textures.size() - 1);
+				break;
+			case DrawCommandType::PushTransform:
+				m_transforms << other.m_transforms[command.resource];
+				command.resource = static_cast<uint32>(m_transforms.size() - 1);
+				break;
+			default:
+				break;
+			}
+			m_commands << command;
 		}
-	};
+	}
 
-	void UIElement::build(const RectF& rect, const Relative& parentRelative)
+	void DrawList::submit()const
 	{
-		Relative relative = parentRelative;
+		//再生中の描画は記録しない
+		DrawList* const recording = std::exchange(g_drawList, nullptr);
+		submitRange(0);
+		g_drawList = recording;
+	}
 
-		if (m_relative)
+	void DrawList::clear()noexcept
+	{
+		m_commands.clear();
+		m_texts.clear();
+		m_textures.clear();
+		m_transforms.clear();
+	}
+
+	bool DrawList::isEmpty()const noexcept
+	{
+		return m_commands.isEmpty();
+	}
+
+	size_t DrawList::size()const noexcept
+	{
+		return m_commands.size();
+	}
+
+	const Array<DrawCommand>& DrawList::getCommands()const noexcept
+	{
+		return m_commands;
+	}
+
+	size_t DrawList::count(DrawCommandType type)const noexcept
+	{
+		return static_cast<size_t>(std::count_if(m_commands.begin(), m_commands.end(), [&](const DrawCommand& command) { return command.type == type; }));
+	}
+
+	size_t DrawList::getDrawCallCount()const noexcept
+	{
+		return static_cast<size_t>(std::count_if(m_commands.begin(), m_commands.end(), [](const DrawCommand& command) { return command.type < DrawCommandType::PushClip; }));
+	}
+
+	const DrawableText& DrawList::getText(const DrawCommand& command)const
+	{
+		return m_texts[command.resource].text;
+	}
+
+	const TextStyle& DrawList::getTextStyle(const DrawCommand& command)const
+	{
+		return m_texts[command.resource].textStyle;
+	}
+
+	const TextureRegion& DrawList::getTexture(const DrawCommand& command)const
+	{
+		return m_textures[command.resource];
+	}
+
+	const Mat3x2& DrawList::getTransform(const DrawCommand& command)const
+	{
+		return m_transforms[command.resource];
+	}
+
+	size_t DrawList::submitRange(size_t index)const
+	{
+		while (index < m_commands.size())
 		{
-			relative = m_relative.value();
+			const DrawCommand& command = m_commands[index++];
+			const RectF& rect = command.rect;
+
+			switch (command.type)
+			{
+			case DrawCommandType::Rect:
+				rect.draw(command.color);
+				break;
+			case DrawCommandType::RectFrame:
+				rect.drawFrame(command.value, command.color);
+				break;
+			case DrawCommandType::RoundRect:
+				rect.rounded(command.value).draw(command.color);
+				break;
+			case DrawCommandType::Circle:
+				Circle{ rect.x,rect.y,rect.w }.draw(command.color);
+				break;
+			case DrawCommandType::Line:
+				Line{ rect.pos,rect.size }.draw(command.value, command.color);
+				break;
+			case DrawCommandType::Text:
+				getText(command).draw(getTextStyle(command), command.value, rect, command.color);
+				break;
+			case DrawCommandType::TextAt:
+				getText(command).draw(getTextStyle(command), command.value, rect.pos, command.color);
+				break;
+			case DrawCommandType::Texture:
+				getTexture(command).drawAt(rect.pos, command.color);
+				break;
+			case DrawCommandType::PremultipliedTexture:
+			{
+				const ScopedRenderStates2D blend{ BlendState::Premultiplied };
+				getTexture(command).drawAt(rect.pos, command.color);
+				break;
+			}
+			case DrawCommandType::PushClip:
+			{
+				const Painter::ScopedClip clip{ rect };
+				index = submitRange(index);
+				break;
+			}
+			case DrawCommandType::PushTransform:
+			{
+				const Painter::ScopedTransform transform{ getTransform(command) };
+				index = submitRange(index);
+				break;
+			}
+			case DrawCommandType::PushColorMul:
+			{
+				const Painter::ScopedColorMul colorMul{ command.color };
+				index = submitRange(index);
+				break;
+			}
+			case DrawCommandType::PopClip:
+			case DrawCommandType::PopTransform:
+			case DrawCommandType::PopColorMul:
+				return index;
+			}
 		}
 
-		RectF area = rect;
-		area.x += m_margine.left;
-		area.y += m_margine.top;
-		area.w -= m_margine.getHorizontal();
-		area.h -= m_margine.getVertical();
+		return index;
+	}
 
-		SizeF size;
+	//-----------------------------------------------
+	//  Painter
+	//-----------------------------------------------
 
-		if (relative.x.stretch && relative.y.stretch)
+	void Painter::DrawRect(const RectF& rect, const ColorF& color)
+	{
+		BUNCHOUI_COUNT_STATS(drawCommands);
+
+		if (g_drawList)
 		{
-			size = area.size;
+			g_drawList->addRect(rect, color);
 		}
 		else
 		{
-			size = getSizeWithoutMargine();
+			rect.draw(color);
+		}
+	}
+
+	void Painter::DrawRectFrame(const RectF& rect, double thickness, const ColorF& color)
+	{
+		BUNCHOUI_COUNT_STATS(drawCommands);
+
+		if (g_drawList)
+		{
+			g_drawList->addRectFrame(rect, thickness, color);
+		}
+		else
+		{
+			rect.drawFrame(thickness, color);
+		}
+	}
+
+	void Painter::DrawRoundRect(const RoundRect& roundRect, const ColorF& color)
+	{
+		BUNCHOUI_COUNT_STATS(drawCommands);
+
+		if (g_drawList)
+		{
+			g_drawList->addRoundRect(roundRect, color);
+		}
+		else
+		{
+			roundRect.draw(color);
+		}
+	}
+
+	void Painter::DrawCircle(const Circle& circle, const ColorF& color)
+	{
+		BUNCHOUI_COUNT_STATS(drawCommands);
+
+		if (g_drawList)
+		{
+			g_drawList->addCircle(circle, color);
+		}
+		else
+		{
+			circle.draw(color);
+		}
+	}
+
+	void Painter::DrawLine(const Line& line, double thickness, const ColorF& color)
+	{
+		BUNCHOUI_COUNT_STATS(drawCommands);
+
+		if (g_drawList)
+		{
+			g_drawList->addLine(line, thickness, color);
+		}
+		else
+		{
+			line.draw(thickness, color);
+		}
+	}
+
+	void Painter::DrawTextInRect(const DrawableText& text, const TextStyle& textStyle, double fontSize, const RectF& rect, const ColorF& color)
+	{
+		BUNCHOUI_COUNT_STATS(drawCommands);
+
+		if (g_drawList)
+		{
+			g_drawList->addText(text, textStyle, fontSize, rect, color);
+		}
+		else
+		{
+			text.draw(textStyle, fontSize, rect, color);
+		}
+	}
+
+	void Painter::DrawTextAt(const DrawableText& text, const TextStyle& textStyle, double fontSize, const Vec2& pos, const ColorF& color)
+	{
+		BUNCHOUI_COUNT_STATS(drawCommands);
+
+		if (g_drawList)
+		{
+			g_drawList->addTextAt(text, textStyle, fontSize, pos, color);
+		}
+		else
+		{
+			text.draw(textStyle, fontSize, pos, color);
+		}
+	}
+
+	void Painter::DrawTexture(const TextureRegion& texture, const Vec2& center, const ColorF& color)
+	{
+		BUNCHOUI_COUNT_STATS(drawCommands);
+
+		if (g_drawList)
+		{
+			g_drawList->addTexture(texture, center, color);
+		}
+		else
+		{
+			texture.drawAt(center, color);
+		}
+	}
+
+	void Painter::DrawPremultipliedTexture(const TextureRegion& texture, const Vec2& center, const ColorF& color)
+	{
+		BUNCHOUI_COUNT_STATS(drawCommands);
+
+		if (g_drawList)
+		{
+			g_drawList->addPremultipliedTexture(texture, center, color);
+		}
+		else
+		{
+			const ScopedRenderStates2D blend{ BlendState::Premultiplied };
+			texture.drawAt(center, color);
+		}
+	}
+
+	BlendState Painter::PremultipliedTargetBlend()
+	{
+		//色は透明度を掛けて重ね、アルファは手前のものを上に重ねる
+		BlendState blend = BlendState::Default2D;
+		blend.srcAlpha = Blend::One;
+		blend.dstAlpha = Blend::InvSrcAlpha;
+		blend.opAlpha = BlendOp::Add;
+		return blend;
+	}
+
+	bool Painter::IsRecording()noexcept
+	{
+		return g_drawList != nullptr;
+	}
+
+	Painter::ScopedRecording::ScopedRecording(DrawList& drawList)noexcept
+		: m_previous{ std::exchange(g_drawList, &drawList) } {}
+
+	Painter::ScopedRecording::~ScopedRecording()
+	{
+		g_drawList = m_previous;
+	}
+
+	Painter::ScopedImmediate::ScopedImmediate()noexcept
+		: m_previous{ std::exchange(g_drawList, nullptr) } {}
+
+	Painter::ScopedImmediate::~ScopedImmediate()
+	{
+		g_drawList = m_previous;
+	}
+
+	Painter::ScopedClip::ScopedClip(const RectF& rect)
+		: m_drawList{ g_drawList }
+	{
+		if (m_drawList)
+		{
+			m_drawList->pushClip(rect);
+			return;
+		}
+
+		m_oldScissorRect = Graphics2D::GetScissorRect();
+		//親もスクロールしている場合があるので、画面上の長方形に直す
+		Rect scissorRect = Graphics2D::GetLocalTransform().transformRect(rect).boundingRect().asRect();
+
+		//外側でも切り抜いているときは、重なる部分だけを残す
+		if (Graphics2D::GetRasterizerState().scissorEnable)
+		{
+			scissorRect = OverlapRect(scissorRect, m_oldScissorRect);
+
+			//外側の範囲に収まっているなら、状態を変える必要はない
+			if (scissorRect == m_oldScissorRect)
+			{
+				return;
+			}
+		}
+
+		BUNCHOUI_COUNT_STATS(clipChanges);
+		Graphics2D::SetScissorRect(scissorRect);
+		RasterizerState rs = RasterizerState::Default2D;
+		rs.scissorEnable = true;
+		m_rasterizer.emplace(rs);
+	}
+
+	Painter::ScopedClip::~ScopedClip()
+	{
+		if (m_drawList)
+		{
+			m_drawList->popClip();
+			return;
+		}
+
+		if (m_rasterizer)
+		{
+			Graphics2D::SetScissorRect(m_oldScissorRect);
+		}
+	}
+
+	Painter::ScopedTransform::ScopedTransform(const Mat3x2& transform)
+		: m_drawList{ g_drawList }
+	{
+		if (m_drawList)
+		{
+			m_drawList->pushTransform(transform);
+			return;
+		}
+
+		m_transformer.emplace(transform);
+	}
+
+	Painter::ScopedTransform::~ScopedTransform()
+	{
+		if (m_drawList)
+		{
+			m_drawList->popTransform();
+		}
+	}
+
+	Painter::ScopedColorMul::ScopedColorMul(const ColorF& color)
+		: m_drawList{ g_drawList }
+	{
+		if (m_drawList)
+		{
+			m_drawList->pushColorMul(color);
+			return;
+		}
+
+		m_colorMul.emplace(color);
+	}
+
+	Painter::ScopedColorMul::~ScopedColorMul()
+	{
+		if (m_drawList)
+		{
+			m_drawList->popColorMul();
+		}
+	}
+
+	//-----------------------------------------------
+	//  UIElement
+	//-----------------------------------------------
+
+	UIElement::~UIElement()
+	{
+		if (m_hasMouseCapture)
+		{
+			CursorSystem::SetCapture(false);
+		}
+
+		if (m_hitTestIndexId)
+		{
+			++g_hitTestIndexedDestroyed;
+		}
+
+		if (m_flatTree)
+		{
+			m_flatTree->release(*this);
+		}
+
+		if (m_notifyParentDeferred)
+		{
+			std::replace(g_deferredElements.begin(), g_deferredElements.end(), this, static_cast<UIElement*>(nullptr));
+		}
+
+		//ハンドラの中で消されたUIには、それ以上イベントを送らない
+		for (UIManager* manager : g_managers)
+		{
+			manager->releaseElement(this);
+		}
+
+		std::replace(g_dispatchPath.begin(), g_dispatchPath.end(), this, static_cast<UIElement*>(nullptr));
+	}
+
+	void UIElement::update()
+	{
+		//何もしない部分木は、カーソルが近くに無いかスクロールで隠れていれば更新しない
+		if (m_sleeping && m_updateBoundsValid && (not m_updateBounds.mouseOver() || (g_updateArea && not g_updateArea->intersects(getMargineRect()))))
+		{
+			BUNCHOUI_COUNT_STATS(updateSkips);
+			return;
+		}
+
+		BUNCHOUI_COUNT_STATS(updateVisits);
+
+		m_isAvailableCursor = (not CursorSystem::IsCaptured()) || hasMouseCapture();
+
+		const bool mouseOvered = m_mouseOvered;
+
+		m_mouseOvered = m_isAvailableCursor && isHitTestCandidate() && onMouseOver();
+
+		if (m_mouseOvered && m_clickable)
+		{
+			CursorSystem::RequestHandStyle();
+		}
+
+		onUpdate();
+
+		if (m_mouseOvered)
+		{
+			//子孫より後に調べるので、最初に見つかったものが一番深い
+			if (g_updatingManager && not g_updatingManager->m_hoverTarget)
+			{
+				g_updatingManager->m_hoverTarget = this;
+			}
+
+			CursorSystem::SetCaptureOneFrame(true);
+		}
+
+		if (g_updatingManager && m_mouseOvered != mouseOvered && not m_eventListeners.isEmpty())
+		{
+			g_updatingManager->m_pendingEvents << UIManager::PendingEvent{ (m_mouseOvered ? UIEventType::Enter : UIEventType::Leave), this };
+		}
+
+		//マウスが触れている間や動いている間と、その直後のフレームは見た目が変わりうる
+		const bool paintActive = isPaintActive();
+		if (paintActive || m_paintActive)
+		{
+			changePaint();
+		}
+		m_paintActive = paintActive;
+
+		updateSleepState();
+	};
+
+	void UIElement::draw(const RectF& drawArea)const
+	{
+		BUNCHOUI_COUNT_STATS(drawVisits);
+
+		if (not g_drawList || not g_previousDrawList)
+		{
+			onDraw(drawArea);
+			return;
+		}
+
+		DrawList& drawList = *g_drawList;
+		const uint32 begin = static_cast<uint32>(drawList.size());
+		const Optional<uint32> previousBegin = findPreviousDraw();
+
+		if (previousBegin && not m_paintDirty && m_drawArea == drawArea)
+		{
+			BUNCHOUI_COUNT_STATS(drawReplays);
+			drawList.append(*g_previousDrawList, *previousBegin, *previousBegin + m_drawLength);
+		}
+		else
+		{
+			//子供はこの間に、前のフレームでの自身の位置から子供の記録を探す
+			m_previousDrawBegin = previousBegin;
+			m_previousDrawRun = m_drawRun;
+			m_drawRun = ++g_drawRunCount;
+			m_drawBegin = begin;
+			onDraw(drawArea);
+			m_previousDrawBegin.reset();
+			m_drawArea = drawArea;
+			m_paintDirty = false;
+
+			//描画範囲の外で描かなかった子供の印も消す(印が無いUIの子孫にも印は無い)
+			//描かなかった子供は前の記録が無いので、見えるようになったときに描き直される
+			const_cast<UIElement*>(this)->forEachChild([](UIElement* child)
+				{
+					if (child->m_drawFrame != g_drawFrame)
+					{
+						ClearPaintDirty(*child);
+					}
+				});
+		}
+
+		m_drawFrame = g_drawFrame;
+		m_drawBegin = begin;
+		m_drawLength = static_cast<uint32>(drawList.size()) - begin;
+
+		if (const UIElement* parent = m_parent)
+		{
+			m_drawOffset = begin - parent->m_drawBegin;
+			m_parentDrawRun = parent->m_drawRun;
+		}
+	}
+
+	Optional<uint32> UIElement::findPreviousDraw()const noexcept
+	{
+		if (m_drawFrame + 1 == g_drawFrame)
+		{
+			return m_drawBegin;
+		}
+
+		//前のフレームで親の記録ごと再生された場合は、親の記録の中の位置から求める
+		const UIElement* parent = m_parent;
+		if (parent && parent->m_previousDrawBegin && m_parentDrawRun == parent->m_previousDrawRun)
+		{
+			return *parent->m_previousDrawBegin + m_drawOffset;
+		}
+
+		return none;
+	}
+
+	void UIElement::updateSleepState()
+	{
+		bool childrenSleeping = true;
+		uint32 childIndex = 0;
+		m_awakeChildBegin = UINT32_MAX;
+		m_awakeChildEnd = 0;
+		m_updateBounds = getHitTestRect();
+		m_updateBoundsValid = true;
+
+		//子供の座標系が違う場合は、自身の範囲だけで判定する
+		const bool unionChildren = not isHitTestIndexBoundary();
+
+		forEachChild([&](UIElement* child)
+			{
+				if (not child->m_sleeping)
+				{
+					childrenSleeping = false;
+					m_awakeChildBegin = Min(m_awakeChildBegin, childIndex);
+					m_awakeChildEnd = childIndex + 1;
+				}
+				++childIndex;
+
+				//自身の範囲だけで判定する場合は、スクロールで隠れて更新されない子供の範囲を待たない
+				if (unionChildren)
+				{
+					m_updateBoundsValid = m_updateBoundsValid && child->m_updateBoundsValid;
+					m_updateBounds = BoundingRect(m_updateBounds, child->m_updateBounds);
+				}
+			});
+
+		m_sleeping = not m_mouseOvered && not needsUpdate() && childrenSleeping;
+	}
+
+	void UIElement::build(const RectF& rect, const Relative& parentRelative)
+	{
+		m_updateBoundsValid = false;
+		changePaint();
+
+		Relative relative = parentRelative;
+
+		if (m_relative)
+		{
+			relative = m_relative.value();
+		}
+
+		RectF area = rect;
+		area.x += m_margine.left;
+		area.y += m_margine.top;
+		area.w -= m_margine.getHorizontal();
+		area.h -= m_margine.getVertical();
+
+		SizeF size;
+
+		if (relative.x.stretch && relative.y.stretch)
+		{
+			size = area.size;
+		}
+		else
+		{
+			size = measureWithoutMargine(BoxConstraints::Unbounded());
+
+			if (area.w < size.x)
+			{
+				if (area.h < size.y)
+				{
+					size = area.size;
+				}
+				else
+				{
+					size.x = area.w;
+					if (relative.y.stretch)
+					{
+						size.y = area.h;
+					}
+					else
+					{
+						size.y = measureWithoutMargine(BoxConstraints::TightWidth(area.w)).y;
+					}
+				}
+			}
+			else if (area.h < size.y)
+			{
+				size.y = area.h;
+
+				if (relative.x.stretch)
+				{
+					size.x = area.w;
+				}
+				else
+				{
+					size.x = measureWithoutMargine(BoxConstraints::TightHeight(area.h)).x;
+				}
+			}
+			else
+			{
+				if (relative.x.stretch)
+				{
+					size.x = area.w;
+				}
+
+				if (relative.y.stretch)
+				{
+					size.y = area.h;
+				}
+			}
+		}
+
+		const RectF newRect
+		{
+			area.x + (area.w - size.x) * relative.x.relative,
+			area.y + (area.h - size.y) * relative.y.relative,
+			size
+		};
+
+		m_relayoutFlg = false;
+
+		if (m_changeSizeFlg)
+		{
+			m_changeSizeFlg = false;
+		}
+		else if (m_rect.size == newRect.size)
+		{
+			if (m_rect.pos != newRect.pos)
+			{
+				moveBy(newRect.pos - m_rect.pos);
+			}
+			m_buildRect = rect;
+			m_buildRelative = parentRelative;
+			return;
+		}
+
+		m_buildRect = rect;
+		m_buildRelative = parentRelative;
+		m_rect = newRect;
+		BUNCHOUI_COUNT_STATS(buildCalls);
+		onBuild();
+	}
+
+	void UIElement::moveBy(const Vec2& pos)
+	{
+		BUNCHOUI_COUNT_STATS(moveByCalls);
+		m_rect.pos += pos;
+		m_buildRect.pos += pos;
+		m_updateBoundsValid = false;
+		changePaint();
+		onMoveBy(pos);
+	}
+
+	void UIElement::onMoveBy(const Vec2&)
+	{
+		BUNCHOUI_COUNT_STATS(buildCalls);
+		onBuild();
+	}
+
+	void UIElement::onUpdate() {}
+
+	void UIElement::onDraw(const RectF&)const {}
+
+	void UIElement::onBuild() {}
+
+	SizeF UIElement::onGetSize()const
+	{
+		return onMeasure(BoxConstraints::Unbounded());
+	}
+
+	double UIElement::onGetX(double)const
+	{
+		return onGetSize().x;
+	}
+
+	double UIElement::onGetY(double)const
+	{
+		return onGetSize().y;
+	}
+
+	bool UIElement::onMouseOver()const
+	{
+		return getRect().mouseOver();
+	}
+
+	void UIElement::forEachChild(const std::function<void(UIElement*)>&) {}
+
+	bool UIElement::needsUpdate()const
+	{
+		//onUpdateで何をするか分からないので、毎フレーム更新する
+		return true;
+	}
+
+	bool UIElement::isPaintActive()const
+	{
+		return m_mouseOvered || needsUpdate();
+	}
+
+	RectF UIElement::getHitTestRect()const noexcept
+	{
+		return getMargineRect();
+	}
+
+	bool UIElement::isRelayoutBoundary()const noexcept
+	{
+		return m_width && m_height;
+	}
+
+	bool UIElement::isHitTestIndexBoundary()const noexcept
+	{
+		return false;
+	}
+
+	const Optional<RectF>& UIElement::GetUpdateArea()noexcept
+	{
+		return g_updateArea;
+	}
+
+	bool UIElement::IsPaintDirty(const UIElement& element)noexcept
+	{
+		return element.m_paintDirty;
+	}
+
+	void UIElement::ClearPaintDirty(UIElement& element)
+	{
+		//印が無い部分木の子孫にも印は無い
+		if (not element.m_paintDirty)
+		{
+			return;
+		}
+
+		element.m_paintDirty = false;
+		element.forEachChild([](UIElement* child) { ClearPaintDirty(*child); });
+	}
+
+	void UIElement::relayout(Array<UIElement*>& relayoutRoots)
+	{
+		if (m_relayoutFlg)
+		{
+			BUNCHOUI_COUNT_STATS(localRelayouts);
+			build(m_buildRect, m_buildRelative);
+			relayoutRoots << this;
+		}
+
+		if (m_descendantRelayoutFlg)
+		{
+			m_descendantRelayoutFlg = false;
+			forEachChild([&](UIElement* child) { child->relayout(relayoutRoots); });
+		}
+	}
+
+	void UIElement::collectDamage(Array<RectF>& rects)
+	{
+		//印が無い部分木の子孫にも印は無い
+		if (not m_paintDirty)
+		{
+			return;
+		}
+
+		if (m_damaged)
+		{
+			m_damaged = false;
+
+			//ふちの半透明な画素の分だけ広げる
+			const RectF rect = BoundingRect(getRect(), getHitTestRect()).stretched(1);
+			if (m_damageRect && *m_damageRect != rect)
+			{
+				rects << *m_damageRect;
+			}
+			rects << rect;
+			m_damageRect = rect;
+		}
+
+		onCollectDamage(rects);
+	}
+
+	void UIElement::onCollectDamage(Array<RectF>& rects)
+	{
+		forEachChild([&](UIElement* child) { child->collectDamage(rects); });
+	}
+
+	void UIElement::collectHitTestChanges(Array<UIElement*>& elements)
+	{
+		if (m_hitTestDirty)
+		{
+			m_hitTestDirty = false;
+			elements << this;
+		}
+
+		if (m_descendantHitTestDirty)
+		{
+			m_descendantHitTestDirty = false;
+			forEachChild([&](UIElement* child) { child->collectHitTestChanges(elements); });
+		}
+	}
+
+	bool UIElement::isHitTestCandidate()const noexcept
+	{
+		return m_hitTestIndexId != g_activeHitTestIndex || m_hitTestFrame == g_hitTestFrame;
+	}
+
+	SizeF UIElement::measure(const BoxConstraints& constraints)
+	{
+		const SizeF margine = m_margine.getSize();
+		return measureWithoutMargine(constraints.deflate(margine)) + margine;
+	}
+
+	SizeF UIElement::getSize()
+	{
+		return measure(BoxConstraints::Unbounded());
+	}
+
+	double UIElement::getX(double y)
+	{
+		return measure(BoxConstraints::TightHeight(y)).x;
+	}
+
+	double UIElement::getY(double x)
+	{
+		return measure(BoxConstraints::TightWidth(x)).y;
+	}
+
+	SizeF UIElement::measureWithoutMargine(BoxConstraints constraints)
+	{
+		//横幅や縦幅が設定されていれば、制約より優先する
+		if (m_width)
+		{
+			constraints.min.x = constraints.max.x = m_width.value();
+		}
+
+		if (m_height)
+		{
+			constraints.min.y = constraints.max.y = m_height.value();
+		}
+
+		if (const auto size = m_measureCache.find(constraints))
+		{
+			++g_measureStats.hits;
+			BUNCHOUI_COUNT_STATS(measureHits);
+			return *size;
+		}
+
+		++g_measureStats.misses;
+		BUNCHOUI_COUNT_STATS(measureMisses);
+		const SizeF size = onMeasure(constraints);
+		m_measureCache.add(constraints, size);
+		return size;
+	}
+
+	SizeF UIElement::onMeasure(const BoxConstraints& constraints)const
+	{
+		//決まっている軸があれば、もう一方の軸をonGetX・onGetYで計算する
+		if (constraints.hasTightWidth())
+		{
+			if (constraints.hasTightHeight())
+			{
+				return constraints.min;
+			}
+			return { constraints.min.x,onGetY(constraints.min.x) };
+		}
+		else if (constraints.hasTightHeight())
+		{
+			return { onGetX(constraints.min.y),constraints.min.y };
+		}
+
+		SizeF size = onGetSize();
+
+		if (constraints.max.x < size.x)
+		{
+			size = { constraints.max.x,onGetY(constraints.max.x) };
+		}
+
+		return constraints.constrain(size);
+	}
+
+	UIElement::MeasureStats UIElement::GetMeasureStats()noexcept
+	{
+		return g_measureStats;
+	}
+
+	void UIElement::ResetMeasureStats()noexcept
+	{
+		g_measureStats = {};
+	}
+
+	void UIElement::BeginTransaction()noexcept
+	{
+		++g_transactionDepth;
+	}
+
+	void UIElement::CommitTransaction()
+	{
+		if (g_transactionDepth == 0 || --g_transactionDepth != 0)
+		{
+			return;
+		}
+
+		//祖先が通知済みなら途中で止まるので、同じ祖先を何度もたどらない
+		const Array<UIElement*> elements = std::move(g_deferredElements);
+		g_deferredElements.clear();
+
+		for (UIElement* element : elements)
+		{
+			if (element)
+			{
+				element->m_notifyParentDeferred = false;
+				element->notifyParent();
+			}
+		}
+	}
+
+	bool UIElement::IsInTransaction()noexcept
+	{
+		return g_transactionDepth != 0;
+	}
+
+	void UIElement::deferNotifyParent()
+	{
+		if (not m_notifyParentDeferred)
+		{
+			m_notifyParentDeferred = true;
+			g_deferredElements << this;
+		}
+	}
+
+	void UIElement::DispatchEvent(UIEvent& event, const bool bubbles)
+	{
+		g_dispatchPath.clear();
+		for (UIElement* element = event.target; element; element = element->m_parent)
+		{
+			g_dispatchPath << element;
+		}
+
+		if (bubbles)
+		{
+			for (size_t i = g_dispatchPath.size(); i-- > 1 && not event.stopped;)
+			{
+				HandleEvent(i, event, true);
+			}
+		}
+
+		if (not event.stopped)
+		{
+			HandleEvent(0, event, true);
+			HandleEvent(0, event, false);
+		}
+
+		if (bubbles)
+		{
+			for (size_t i = 1; i < g_dispatchPath.size() && not event.stopped; ++i)
+			{
+				HandleEvent(i, event, false);
+			}
+		}
+
+		g_dispatchPath.clear();
+	}
+
+	void UIElement::HandleEvent(const size_t pathIndex, UIEvent& event, const bool capture)
+	{
+		UIElement* const element = g_dispatchPath[pathIndex];
+
+		if (not element || (IsButtonEvent(event.type) && not element->m_clickable))
+		{
+			return;
+		}
+
+		event.currentTarget = element;
+
+		for (size_t i = 0; i < element->m_eventListeners.size(); ++i)
+		{
+			const EventListener& listener = element->m_eventListeners[i];
+
+			if (listener.type != event.type || listener.capture != capture)
+			{
+				continue;
+			}
+
+			//reconcileなどでハンドラ自身が書き換えられても呼び終えられるように、コピーしてから呼ぶ
+			const UIEventHandler handler = listener.handler;
+			handler(event);
+
+			//ハンドラの中で消されたか、clickableが外された
+			if (g_dispatchPath.size() <= pathIndex || not g_dispatchPath[pathIndex] || (IsButtonEvent(event.type) && not element->m_clickable))
+			{
+				return;
+			}
+		}
+	}
+
+	bool UIElement::reconcile(UIElement& source)
+	{
+		if (&source == this)
+		{
+			return true;
+		}
+
+		if (typeid(*this) != typeid(source) || m_key != source.m_key)
+		{
+			return false;
+		}
+
+		setClickable(source.m_clickable);
+
+		m_eventListeners = source.m_eventListeners;
+
+		//変わった設定があるときだけ再配置する
+		if (m_margine != source.m_margine || m_width != source.m_width || m_height != source.m_height || m_flex != source.m_flex || m_relative != source.m_relative)
+		{
+			m_margine = source.m_margine;
+			m_width = source.m_width;
+			m_height = source.m_height;
+			m_flex = source.m_flex;
+			m_relative = source.m_relative;
+			changeLayout();
+		}
+
+		onReconcile(source);
+
+		//派生クラスの見た目の設定が変わっているかもしれない
+		changePaint();
+
+		return true;
+	}
+
+	void UIElement::onReconcile(UIElement&) {}
+
+	////-----------------------------------------------
+	////  NoneUI
+	////-----------------------------------------------
+
+	void NoneUI::onDraw(const RectF&)const
+	{
+		RectF rect = getRect();
+		Painter::DrawRectFrame(rect, 2, Palette::Red);
+		Painter::DrawLine(Line{ rect.tl(),rect.br() }, 2, Palette::Red);
+		Painter::DrawLine(Line{ rect.tr(),rect.bl() }, 2, Palette::Red);
+	}
+
+	SizeF NoneUI::onGetSize()const
+	{
+		return SizeF{ 20,20 };
+	}
+
+	bool NoneUI::needsUpdate()const
+	{
+		return false;
+	}
+
+	//-----------------------------------------------
+	//  ChildrenContainer
+	//-----------------------------------------------
+
+	void ChildrenContainer::forEachChild(const std::function<void(UIElement*)>& func)
+	{
+		for (const auto& child : m_children)
+		{
+			func(child.get());
+		}
+	}
+
+	void ChildrenContainer::onMoveBy(const Vec2& pos)
+	{
+		for (const auto& child : m_children)
+		{
+			child->moveBy(pos);
+		}
+	}
+
+	void ChildrenContainer::onUpdate()
+	{
+		for (size_t i = 0; i < m_children.size(); ++i)
+		{
+			m_children[m_children.size() - 1 - i]->update();
+		}
+	}
+
+	void ChildrenContainer::onDraw(const RectF& drawingArea)const
+	{
+		for (const auto& child : m_children)
+		{
+			if (drawingArea.intersects(child->getMargineRect()))
+			{
+				child->draw(drawingArea);
+			}
+		}
+	}
+
+	bool ChildrenContainer::isPaintActive()const
+	{
+		//並べるだけで、自身の見た目はカーソルに反応しない
+		return false;
+	}
+
+	void ChildrenContainer::reconcileChildren(const Array<std::shared_ptr<UIElement>>& children)
+	{
+		HashTable<String, size_t> keyedChildren;
+		for (size_t i = 0; i < m_children.size(); ++i)
+		{
+			if (m_children[i]->getKey())
+			{
+				keyedChildren.emplace(m_children[i]->getKey(), i);
+			}
+		}
+
+		Array<bool> reused(m_children.size(), false);
+		Array<std::shared_ptr<UIElement>> result;
+		result.reserve(children.size());
+
+		for (size_t i = 0; i < children.size(); ++i)
+		{
+			const auto& child = children[i];
+
+			//キーがあればキーで、無ければ同じ位置の子供と照合する
+			Optional<size_t> index;
+			if (child->getKey())
+			{
+				if (auto it = keyedChildren.find(child->getKey()); it != keyedChildren.end())
+				{
+					index = it->second;
+				}
+			}
+			else if (i < m_children.size() && not m_children[i]->getKey())
+			{
+				index = i;
+			}
+
+			if (index && not reused[*index] && m_children[*index]->reconcile(*child))
+			{
+				reused[*index] = true;
+				result << m_children[*index];
+			}
+			else
+			{
+				result << child;
+			}
+		}
+
+		if (result != m_children)
+		{
+			for (size_t i = 0; i < m_children.size(); ++i)
+			{
+				if (not reused[i] && m_children[i]->getParent() == this)
+				{
+					m_children[i]->setParent(nullptr);
+				}
+			}
+
+			m_children = std::move(result);
+			changeSize();
+		}
+
+		//新しく作った子供や、共有していて新しく作った側に付け替えられた子供を付け直す
+		for (const auto& child : m_children)
+		{
+			if (child->getParent() != this)
+			{
+				child->setParent(this);
+			}
+		}
+	}
+
+	void ChildrenContainer::reconcileChild(size_t index, const std::shared_ptr<UIElement>& child)
+	{
+		if (not m_children[index]->reconcile(*child))
+		{
+			replaceChild(index, child);
+		}
+		else if (m_children[index]->getParent() != this)
+		{
+			//共有しているUIは、新しく作った側に付け替えられていることがある
+			m_children[index]->setParent(this);
+		}
+	}
+
+	void ChildrenContainer::onReconcile(UIElement& source)
+	{
+		reconcileChildren(static_cast<ChildrenContainer&>(source).m_children);
+	}
+
+	//-----------------------------------------------
+	//  ChildContainer
+	//-----------------------------------------------
+
+	void ChildContainer::forEachChild(const std::function<void(UIElement*)>& func)
+	{
+		func(m_child.get());
+	}
+
+	void ChildContainer::onBuild()
+	{
+		m_child->build(getRect());
+	}
+
+	SizeF ChildContainer::onGetSize()const
+	{
+		return m_child->getSize();
+	}
+
+	double ChildContainer::onGetX(double y)const
+	{
+		return m_child->getX(y);
+	}
+
+	double ChildContainer::onGetY(double x)const
+	{
+		return m_child->getY(x);
+	}
+
+	void ChildContainer::onMoveBy(const Vec2& pos)
+	{
+		m_child->moveBy(pos);
+	}
+
+	bool ChildContainer::isPaintActive()const
+	{
+		//子供の見た目の変化は子供自身が通知する
+		return false;
+	}
+
+	void ChildContainer::reconcileChild(const std::shared_ptr<UIElement>& child)
+	{
+		if (not m_child->reconcile(*child))
+		{
+			setChild(child);
+		}
+		else if (m_child->getParent() != this)
+		{
+			//共有しているUIは、新しく作った側に付け替えられていることがある
+			m_child->setParent(this);
+		}
+	}
+
+	void ChildContainer::onReconcile(UIElement& source)
+	{
+		reconcileChild(static_cast<ChildContainer&>(source).m_child);
+	}
+
+	//-----------------------------------------------
+	//  PanelBase
+	//-----------------------------------------------
+
+	void PanelBase::onBuild()
+	{
+		RectF area = getRect();
+		area.x += m_padding.left;
+		area.y += m_padding.top;
+		area.w -= m_padding.getHorizontal();
+		area.h -= m_padding.getVertical();
+		m_child->build(area);
+	}
+
+	SizeF PanelBase::onMeasure(const BoxConstraints& constraints)const
+	{
+		if (constraints.hasTightWidth() && constraints.hasTightHeight())
+		{
+			return constraints.min;
+		}
+
+		//パディングの分だけ小さくした制約で子供を測る
+		const SizeF padding = m_padding.getSize();
+		return constraints.constrain(m_child->measure(constraints.deflate(padding)) + padding);
+	}
+
+	void PanelBase::onReconcile(UIElement& source)
+	{
+		setPadding(static_cast<const PanelBase&>(source).m_padding);
+
+		ChildContainer::onReconcile(source);
+	}
+
+	//-----------------------------------------------
+	//  StackUI
+	//-----------------------------------------------
+
+	SizeF StackUI::onMeasure(const BoxConstraints& constraints)const
+	{
+		if (constraints.hasTightWidth() && constraints.hasTightHeight())
+		{
+			return constraints.min;
+		}
+
+		//同じ制約で子供を一度ずつ測り、一番大きいものに合わせる
+		SizeF max{};
+		for (auto& child : m_children)
+		{
+			const SizeF size = child->measure(constraints);
+			max.x = Max(max.x, size.x);
+			max.y = Max(max.y, size.y);
+		}
+		return constraints.constrain(max);
+	}
+
+	bool StackUI::needsUpdate()const
+	{
+		return hasMouseCapture();
+	}
+
+	void StackUI::onBuild()
+	{
+		for (auto& child : m_children)
+		{
+			child->build(getRect());
+		}
+	}
+
+	//-----------------------------------------------
+	//  SimpleDialog
+	//-----------------------------------------------
+
+	void SimpleDialog::onUpdate()
+	{
+		m_transition.update(not m_close);
+
+		if (m_transition.isOne())
+		{
+			childUpdate();
+			if (updateFunc)
+			{
+				updateFunc(this);
+			}
+
+			if (erasable && not m_child->mouseOver() && detail::CurrentMouseInput().leftDown)
+			{
+				close();
+			}
+		}
+
+		if (m_close && m_transition.isZero())
+		{
+			if (auto ptr = getParent<ChildrenContainer>())
+			{
+				ptr->removeChild(this);
+			}
+		}
+	}
+
+	bool SimpleDialog::needsUpdate()const
+	{
+		//フェード中・毎フレームの関数・外側のクリックの監視
+		return m_close || not m_transition.isOne() || updateFunc || erasable;
+	}
+
+	void SimpleDialog::onDraw(const RectF& drawArea)const
+	{
+		const Painter::ScopedColorMul mul{ AlphaF(m_transition.value()) };
+		Painter::DrawRect(getRect(), m_backgroundColor);
+		childDraw(drawArea);
+	}
+
+	bool SimpleDialog::isPaintActive()const
+	{
+		//フェード中だけ見た目が変わる
+		return not m_transition.isOne();
+	}
+
+	void SimpleDialog::onReconcile(UIElement& source)
+	{
+		const auto& dialog = static_cast<const SimpleDialog&>(source);
+		updateFunc = dialog.updateFunc;
+		setBackgroundColor(dialog.m_backgroundColor);
+		erasable = dialog.erasable;
+
+		ChildContainer::onReconcile(source);
+	}
+
+	//-----------------------------------------------
+	//  RectPanel
+	//-----------------------------------------------
+
+	void RectPanel::onUpdate()
+	{
+		childUpdate();
+	}
+
+	bool RectPanel::needsUpdate()const
+	{
+		return hasMouseCapture();
+	}
+
+	void RectPanel::onDraw(const RectF& drawingArea)const
+	{
+		Painter::DrawRoundRect(getRoundRect(), m_color);
+		childDraw(drawingArea);
+	}
+
+	bool RectPanel::onMouseOver()const
+	{
+		return getRoundRect().mouseOver();
+	}
+
+	void RectPanel::onReconcile(UIElement& source)
+	{
+		const auto& panel = static_cast<const RectPanel&>(source);
+		setR(panel.m_r);
+		setColor(panel.m_color);
+
+		PanelBase::onReconcile(source);
+	}
+
+	//-----------------------------------------------
+	//  SimpleButton
+	//-----------------------------------------------
+
+	void SimpleButton::onUpdate()
+	{
+		childUpdate();
+	}
+
+	void SimpleButton::onDraw(const RectF& drawingArea)const
+	{
+		const Painter::ScopedTransform transform{ pressed() ? Mat3x2::Scale(0.95,getRect().center()) : Mat3x2::Identity() };
+		Painter::DrawRoundRect(getRoundRect(), (mouseOver() && isClickable()) ? m_mouseOverColor : m_color);
+		childDraw(drawingArea);
+		if (not isClickable())
+		{
+			Painter::DrawRoundRect(getRoundRect(), ColorF{ 0,0.5 });
+		}
+	}
+
+	bool SimpleButton::needsUpdate()const
+	{
+		return hasMouseCapture();
+	}
+
+	bool SimpleButton::isPaintActive()const
+	{
+		//触れている間は色が変わり、押している間は縮む
+		return mouseOver();
+	}
+
+	bool SimpleButton::onMouseOver()const
+	{
+		return getRoundRect().mouseOver();
+	}
+
+	void SimpleButton::onReconcile(UIElement& source)
+	{
+		const auto& button = static_cast<const SimpleButton&>(source);
+		setR(button.m_r);
+		setColor(button.m_color);
+		setMouseOverColor(button.m_mouseOverColor);
+
+		PanelBase::onReconcile(source);
+	}
+
+	//-----------------------------------------------
+	//  SimpleSlider
+	//-----------------------------------------------
+
+	bool SimpleSlider::onMouseOver()const
+	{
+		const RectF rect = getRect();
+		return RectF{ Arg::center = rect.center(),rect.w, KnobR * 2 }.mouseOver();
+	}
 
-			if (area.w < size.x)
+	RectF SimpleSlider::getHitTestRect()const noexcept
+	{
+		const RectF rect = getRect();
+		return RectF{ Arg::center = rect.center(),rect.w, Max(rect.h,KnobR * 2) };
+	}
+
+	bool SimpleSlider::needsUpdate()const
+	{
+		//離されたフレームの次にm_sliderReleasedを戻す
+		return hasMouseCapture() || m_sliderReleased;
+	}
+
+	void SimpleSlider::onUpdate()
+	{
+		m_sliderReleased = false;
+
+		if (m_enabled && isAvailableCursor())
+		{
+			const RectF rect = getRect();
+			const RectF hitBox{ Arg::center = rect.center(),rect.w, KnobR * 2 };
+
+			if (hasMouseCapture())
 			{
-				if (area.h < size.y)
+				CursorSystem::RequestHandStyle();
+				const double w = rect.w - KnobR * 2;
+				setValue(Clamp(Cursor::PosF().x - (rect.x + KnobR), 0.0, w) / w);
+				if (detail::CurrentMouseInput().leftUp)
 				{
-					size = area.size;
+					m_sliderReleased = true;
+					setMouseCapture(false);
 				}
-				else
+			}
+			else {
+				if (hitBox.mouseOver())
 				{
-					size.x = area.w;
-					if (relative.y.stretch)
+					CursorSystem::RequestHandStyle();
+				}
+				if (hitBox.mouseOver() && detail::CurrentMouseInput().leftDown)
+				{
+					setMouseCapture(true);
+				}
+			}
+		}
+	}
+
+	void SimpleSlider::onDraw(const RectF&)const
+	{
+		const RectF rect = getRect();
+		const double w = rect.w - KnobR * 2;
+		Painter::DrawRect(RectF{ Arg::center = rect.center(),w,BarHeight }, Palette::Gray);
+		const double length = m_value * w;
+		Painter::DrawRect(RectF{ Arg::center = rect.leftCenter() + Vec2{length / 2 + KnobR,0},length,BarHeight }, m_color);
+		if (not m_enabled)
+		{
+			Painter::DrawRect(RectF{ Arg::center = rect.center(),w,BarHeight }, ColorF{ 0,0.4 });
+		}
+		Painter::DrawCircle(Circle{ length + rect.x + KnobR, rect.center().y ,KnobR }, m_enabled ? Palette::White : Palette::Lightgray);
+		if (not m_enabled)
+		{
+			Painter::DrawCircle(Circle{ length + rect.x + KnobR, rect.center().y ,KnobR }, ColorF{ 0,0.4 });
+		}
+	}
+
+	bool SimpleSlider::isPaintActive()const
+	{
+		//値の変化はsetValueが通知する
+		return false;
+	}
+
+	SizeF SimpleSlider::onGetSize()const
+	{
+		return { 150 + KnobR * 2,KnobR * 2 };
+	}
+
+	void SimpleSlider::onReconcile(UIElement& source)
+	{
+		const auto& slider = static_cast<const SimpleSlider&>(source);
+		setColor(slider.m_color);
+		setEnabled(slider.m_enabled);
+
+		//ドラッグ中は操作している値を優先する
+		if (not hasMouseCapture())
+		{
+			setValue(slider.m_value);
+		}
+	}
+
+	//-----------------------------------------------
+	//  SimpleScrollbar
+	//-----------------------------------------------
+
+	void SimpleScrollbar::onUpdate()
+	{
+		const double oldValue = m_value;
+		RectF view = getRect();
+
+		if (isScroll())
+		{
+			view.w -= ScrollbarWidth;
+
+			if (isAvailableCursor())
+			{
+
+				if (hasMouseCapture())
+				{
+					if (detail::CurrentMouseInput().leftUp)
 					{
-						size.y = area.h;
+						setMouseCapture(false);
 					}
-					else
+
+					const double space = view.h * (1 - getRate());
+					m_value = Clamp(m_value + CurrentMouseDelta().y / space, 0.0, 1.0);
+				}
+				else {
+
+					if (getBarRoundRect().mouseOver())
+					{
+						CursorSystem::RequestHandStyle();
+					}
+
+					if (getBarRoundRect().mouseOver() && detail::CurrentMouseInput().leftDown)
+					{
+						setMouseCapture(true);
+					}
+				}
+
+			}
+		}
+
+		const bool mouseOverView = view.mouseOver();
+
+		{
+			//子供は動かさずに、カーソルの方をスクロールした分ずらす
+			const Transformer2D transformer{ Mat3x2::Translate(0,-getScrollPos()),TransformCursor::Yes };
+
+			//枠の外に隠れている子供は、隠れていても更新が必要なものだけを更新する
+			const ScopedUpdateArea updateArea{ view,Vec2{ 0,getScrollPos() } };
+
+			if (mouseOverView)
+			{
+				childUpdate();
+			}
+			else {
+				bool capture = false;
+				//枠の外のカーソルに反応しないようにする
+				if (not CursorSystem::IsCaptured())
+				{
+					setMouseCapture(true);
+					capture = true;
+				}
+
+				childUpdate();
+
+				if (capture)
+				{
+					setMouseCapture(false);
+				}
+			}
+		}
+
+		const double wheel = detail::CurrentMouseInput().wheel;
+		if (isScroll() && mouseOver() && not CursorSystem::IsWheelCaptured() && wheel) {
+			m_value = Clamp(m_value + wheel / (m_childHeight - view.h) * speed, 0.0, 1.0);
+			CursorSystem::SetWheelCaptureOneFrame(true);
+		}
+
+		if (m_value != oldValue)
+		{
+			changePaint();
+		}
+	}
+
+	void SimpleScrollbar::onDraw(const RectF& drawingArea)const
+	{
+		RectF view = getRect();
+		if (isScroll())
+		{
+			view.w -= ScrollbarWidth;
+		}
+
+		//親の描画範囲と重なる部分だけを切り抜き、見えなければ子供は描かない
+		const RectF visible = view.getOverlap(drawingArea);
+		if (0 < visible.w && 0 < visible.h)
+		{
+			const Painter::ScopedClip clip{ visible };
+			const double scrollPos = getScrollPos();
+			const Painter::ScopedTransform transform{ Mat3x2::Translate(0,-scrollPos) };
+			m_child->draw(visible.movedBy(0, scrollPos));
+		}
+
+		if (isScroll())
+		{
+			Painter::DrawRoundRect(getBackBarRoundRect(), ColorF{ 0.9 });
+			Painter::DrawRoundRect(getBarRoundRect(), hasMouseCapture() ? ColorF{ 0.3 } : ColorF{ 0.5 });
+		}
+	}
+
+	bool SimpleScrollbar::needsUpdate()const
+	{
+		return hasMouseCapture();
+	}
+
+	bool SimpleScrollbar::isPaintActive()const
+	{
+		//つまみを掴んでいる間は色が変わる(スクロールはonUpdateで通知する)
+		return hasMouseCapture();
+	}
+
+	void SimpleScrollbar::onBuild()
+	{
+		//子供は常にスクロールしていない位置に置き、スクロールは描画と判定のときに反映する
+		RectF rect = getRect();
+		m_childHeight = m_child->getY(rect.w);
+
+		if (isScroll())
+		{
+			m_childHeight = m_child->getY(rect.w - ScrollbarWidth);
+			m_child->build({ rect.pos,rect.w - ScrollbarWidth,Max(m_childHeight,rect.h) });
+		}
+		else
+		{
+			m_child->build({ rect.pos,rect.w, Max(m_childHeight,rect.h) });
+			m_value = 0;
+		}
+	}
+
+	double SimpleScrollbar::onGetX(double y)const
+	{
+		return m_child->getX(y) + ScrollbarWidth;//スクロールバーの分
+	}
+
+	bool SimpleScrollbar::isHitTestIndexBoundary()const noexcept
+	{
+		//子供はスクロールした分ずれた座標系にある
+		return true;
+	}
+
+	void SimpleScrollbar::onCollectDamage(Array<RectF>& rects)
+	{
+		Array<RectF> childRects;
+		ChildContainer::onCollectDamage(childRects);
+
+		RectF view = getRect();
+		if (isScroll())
+		{
+			view.w -= ScrollbarWidth;
+		}
+
+		//スクロールしていない座標系の範囲を、画面に表示される位置に直す
+		const double scrollPos = getScrollPos();
+		for (const RectF& rect : childRects)
+		{
+			const RectF visible = rect.movedBy(0, -scrollPos).getOverlap(view);
+			if (0 < visible.w && 0 < visible.h)
+			{
+				rects << visible;
+			}
+		}
+	}
+
+	void SimpleScrollbar::onReconcile(UIElement& source)
+	{
+		//スクロール位置は残す
+		speed = static_cast<const SimpleScrollbar&>(source).speed;
+
+		ChildContainer::onReconcile(source);
+	}
+
+	//-----------------------------------------------
+	//  VirtualColumn
+	//-----------------------------------------------
+
+	void VirtualColumn::setItemCount(size_t itemCount)
+	{
+		releaseAllItems();
+		m_itemCount = itemCount;
+
+		if (m_itemCount && not m_prototype)
+		{
+			m_prototype = m_builder(0);
+		}
+
+		resetExtents();
+		changeSize();
+	}
+
+	void VirtualColumn::refresh()
+	{
+		releaseAllItems();
+		m_prototype = m_itemCount ? m_builder(0) : nullptr;
+		changeSize();
+	}
+
+	void VirtualColumn::onUpdate()
+	{
+		notifyExtentChanged();
+		updateVisibleItems();
+
+		for (size_t i = 0; i < m_items.size(); ++i)
+		{
+			m_items[m_items.size() - 1 - i].ui->update();
+		}
+	}
+
+	void VirtualColumn::onDraw(const RectF& drawingArea)const
+	{
+		for (const auto& item : m_items)
+		{
+			if (drawingArea.intersects(item.ui->getMargineRect()))
+			{
+				item.ui->draw(drawingArea);
+			}
+		}
+	}
+
+	bool VirtualColumn::isPaintActive()const
+	{
+		//行の入れ替えは、行が配置されるときに行自身が通知する
+		return false;
+	}
+
+	void VirtualColumn::onBuild()
+	{
+		//行の大きさが変わったときにも呼ばれるので、作り直す
+		m_itemsDirty = true;
+		updateVisibleItems();
+	}
+
+	void VirtualColumn::onMoveBy(const Vec2&)
+	{
+		updateVisibleItems();
+	}
+
+	void VirtualColumn::forEachChild(const std::function<void(UIElement*)>& func)
+	{
+		for (const auto& item : m_items)
+		{
+			func(item.ui.get());
+		}
+	}
+
+	bool VirtualColumn::needsUpdate()const
+	{
+		//スクロールバーのつまみを動かしたときにも行を用意する
+		return true;
+	}
+
+	bool VirtualColumn::isHitTestIndexBoundary()const noexcept
+	{
+		//行はスクロールするたびに入れ替わる
+		return true;
+	}
+
+	SizeF VirtualColumn::onGetSize()const
+	{
+		return { m_prototype ? m_prototype->getSize().x : 0.0,getTotalExtent() };
+	}
+
+	void VirtualColumn::updateVisibleItems()
+	{
+		const RectF rect = getRect();
+		const RectF visible = getVisibleArea();
+
+		if (not m_itemsDirty && rect == m_arrangedRect && visible == m_arrangedVisibleArea)
+		{
+			return;
+		}
+
+		if (m_itemCount == 0)
+		{
+			releaseAllItems();
+			return;
+		}
+
+		m_itemsDirty = false;
+		m_arrangedRect = rect;
+		m_arrangedVisibleArea = visible;
+
+		//見積もりと実際の高さが違ったら、まとめて直してから範囲を求め直す
+		for (;;)
+		{
+			const double top = Clamp(visible.y - rect.y, 0.0, getTotalExtent());
+			const double bottom = Clamp(visible.bottomY() - rect.y, 0.0, getTotalExtent());
+
+			const size_t topIndex = findIndex(top);
+			const size_t first = (m_overscan < topIndex) ? topIndex - m_overscan : 0;
+			const size_t last = Min(findIndex(bottom) + m_overscan, m_itemCount - 1);
+
+			//範囲外の行を片付ける
+			m_items.remove_if([&](const Item& item)
+				{
+					if (item.index < first || last < item.index)
 					{
-						size.y = getYWithoutMargine(area.w);
+						releaseItem(item.ui);
+						return true;
 					}
-				}
-			}
-			else if (area.h < size.y)
-			{
-				size.y = area.h;
+					return false;
+				});
 
-				if (relative.x.stretch)
+			//足りない行を用意する
+			Array<Item> items;
+			items.reserve(last - first + 1);
+			for (size_t i = first, k = 0; i <= last; ++i)
+			{
+				if (k < m_items.size() && m_items[k].index == i)
 				{
-					size.x = area.w;
+					items << m_items[k++];
 				}
 				else
 				{
-					size.x = getXWithoutMargine(area.h);
+					items << Item{ i,acquireItem(i) };
 				}
 			}
-			else
+			m_items = std::move(items);
+
+			if (m_itemHeight)
 			{
-				if (relative.x.stretch)
-				{
-					size.x = area.w;
-				}
+				break;
+			}
 
-				if (relative.y.stretch)
+			bool changeExtentFlg = false;
+			for (const auto& item : m_items)
+			{
+				const double extent = item.ui->getY(rect.w);
+				if (extent != m_extents[item.index])
 				{
-					size.y = area.h;
+					setExtent(item.index, extent);
+					changeExtentFlg = true;
 				}
 			}
+
+			if (not changeExtentFlg)
+			{
+				break;
+			}
+
+			//配置の途中なので、大きさの変更はonUpdateで通知する
+			m_extentChanged = true;
+		}
+
+		for (const auto& item : m_items)
+		{
+			item.ui->build({ rect.x,rect.y + getOffset(item.index),rect.w,getExtent(item.index) }, Relative{ m_crossAxis,0.5 });
+		}
+	}
+
+	void VirtualColumn::notifyExtentChanged()
+	{
+		if (not std::exchange(m_extentChanged, false))
+		{
+			return;
+		}
+
+		//スクロールバーに測り直してもらう(行は測った高さで配置済み)
+		changeSize();
+	}
+
+	RectF VirtualColumn::getVisibleArea()
+	{
+		for (UIElement* parent = getParent(); parent; parent = parent->getParent())
+		{
+			if (const auto scrollbar = dynamic_cast<SimpleScrollbar*>(parent))
+			{
+				return scrollbar->getVisibleRect();
+			}
+		}
+		return Scene::Rect();
+	}
+
+	std::shared_ptr<UIElement> VirtualColumn::acquireItem(size_t index)
+	{
+		std::shared_ptr<UIElement> ui;
+
+		if (m_updater && m_pool)
+		{
+			ui = m_pool.back();
+			m_pool.pop_back();
+			m_updater(index, ui);
+		}
+		else
+		{
+			ui = m_builder(index);
+		}
+
+		ui->setParent(this);
+		return ui;
+	}
+
+	void VirtualColumn::releaseItem(const std::shared_ptr<UIElement>& ui)
+	{
+		ui->setParent(nullptr);
+
+		if (m_updater)
+		{
+			m_pool << ui;
+		}
+	}
+
+	void VirtualColumn::releaseAllItems()
+	{
+		for (const auto& item : m_items)
+		{
+			releaseItem(item.ui);
+		}
+		m_items.clear();
+		m_itemsDirty = true;
+	}
+
+	void VirtualColumn::resetExtents()
+	{
+		m_extents.clear();
+		m_extentTree.clear();
+		m_totalExtent = 0;
+
+		if (m_itemHeight)
+		{
+			return;
+		}
+
+		m_extents.assign(m_itemCount, m_estimatedItemHeight);
+		m_extentTree.assign(m_itemCount + 1, 0.0);
+		m_totalExtent = m_estimatedItemHeight * m_itemCount;
+
+		for (size_t i = 1; i <= m_itemCount; ++i)
+		{
+			m_extentTree[i] += m_extents[i - 1];
+			const size_t parent = i + (i & (~i + 1));
+			if (parent <= m_itemCount)
+			{
+				m_extentTree[parent] += m_extentTree[i];
+			}
+		}
+	}
+
+	void VirtualColumn::setExtent(size_t index, double extent)
+	{
+		const double delta = extent - m_extents[index];
+		m_extents[index] = extent;
+		m_totalExtent += delta;
+
+		for (size_t i = index + 1; i <= m_itemCount; i += (i & (~i + 1)))
+		{
+			m_extentTree[i] += delta;
+		}
+	}
+
+	double VirtualColumn::getOffset(size_t index)const noexcept
+	{
+		if (m_itemHeight)
+		{
+			return *m_itemHeight * index;
+		}
+
+		double sum = 0;
+		for (size_t i = index; 0 < i; i &= i - 1)
+		{
+			sum += m_extentTree[i];
+		}
+		return sum;
+	}
+
+	size_t VirtualColumn::findIndex(double offset)const noexcept
+	{
+		if (m_itemHeight)
+		{
+			if (*m_itemHeight <= 0)
+			{
+				return 0;
+			}
+			return Min(static_cast<size_t>(offset / *m_itemHeight), m_itemCount - 1);
+		}
+
+		size_t step = 1;
+		while (step * 2 <= m_itemCount)
+		{
+			step *= 2;
+		}
+
+		size_t index = 0;
+		for (; 0 < step; step /= 2)
+		{
+			if (index + step <= m_itemCount && m_extentTree[index + step] <= offset)
+			{
+				index += step;
+				offset -= m_extentTree[index];
+			}
+		}
+		return Min(index, m_itemCount - 1);
+	}
+
+	void VirtualColumn::onReconcile(UIElement& source)
+	{
+		const auto& column = static_cast<const VirtualColumn&>(source);
+		m_builder = column.m_builder;
+		m_updater = column.m_updater;
+		m_overscan = column.m_overscan;
+
+		if (m_crossAxis != column.m_crossAxis)
+		{
+			m_crossAxis = column.m_crossAxis;
+			changeSize();
+		}
+
+		//関数は比べられないので、表示中の行は作り直す
+		if (m_itemCount != column.m_itemCount || m_itemHeight != column.m_itemHeight || m_estimatedItemHeight != column.m_estimatedItemHeight)
+		{
+			m_itemHeight = column.m_itemHeight;
+			m_estimatedItemHeight = column.m_estimatedItemHeight;
+			setItemCount(column.m_itemCount);
+		}
+		else
+		{
+			refresh();
+		}
+	}
+
+	//-----------------------------------------------
+	//  RepaintBoundary
+	//-----------------------------------------------
+
+	RepaintBoundary::~RepaintBoundary()
+	{
+		resizeTexture(Size{ 0,0 });
+	}
+
+	RepaintBoundary::CacheStats RepaintBoundary::GetCacheStats()noexcept
+	{
+		return g_repaintCacheStats;
+	}
+
+	void RepaintBoundary::onUpdate()
+	{
+		childUpdate();
+	}
+
+	bool RepaintBoundary::needsUpdate()const
+	{
+		return hasMouseCapture();
+	}
+
+	void RepaintBoundary::onDraw(const RectF&)const
+	{
+		const RectF rect = getRect();
+		const Size size{ static_cast<int32>(std::ceil(rect.w)),static_cast<int32>(std::ceil(rect.h)) };
+
+		if (size.x <= 0 || size.y <= 0)
+		{
+			return;
+		}
+
+		if (size != m_textureSize)
+		{
+			resizeTexture(size);
+		}
+
+		if (not m_cacheValid || IsPaintDirty(*m_child))
+		{
+			render(rect);
+		}
+
+		Painter::DrawPremultipliedTexture(TextureRegion{ m_texture }, rect.pos + Vec2{ size.x / 2.0,size.y / 2.0 }, ColorF{ 1.0 });
+	}
+
+	void RepaintBoundary::resizeTexture(const Size& size)const
+	{
+		if (m_textureSize.x > 0 && m_textureSize.y > 0)
+		{
+			--g_repaintCacheStats.layers;
+			g_repaintCacheStats.bytes -= static_cast<size_t>(m_textureSize.x) * m_textureSize.y * LayerBytesPerPixel;
+		}
+
+		m_textureSize = size;
+		m_cacheValid = false;
+
+		if (size.x > 0 && size.y > 0)
+		{
+			m_texture = MSRenderTexture{ size,ColorF{ 0.0,0.0 } };
+			++g_repaintCacheStats.layers;
+			g_repaintCacheStats.bytes += static_cast<size_t>(size.x) * size.y * LayerBytesPerPixel;
+		}
+		else
+		{
+			m_texture = MSRenderTexture{};
+		}
+	}
+
+	void RepaintBoundary::render(const RectF& rect)const
+	{
+		++g_repaintCacheStats.renders;
+		m_texture.clear(ColorF{ 0.0,0.0 });
+
+		{
+			//記録中でも、テクスチャへはすぐに描く
+			const Painter::ScopedImmediate immediate;
+			const ScopedRenderTarget2D target{ m_texture };
+
+			//透明なテクスチャに乗算済みアルファで描き、表示するときもそのまま重ねる
+			const ScopedRenderStates2D states{ Painter::PremultipliedTargetBlend(),RasterizerState::Default2D };
+
+			//親の座標変換・色・切り抜きは、テクスチャを表示するときに掛かる
+			const ScopedColorMul2D colorMul{ ColorF{ 1.0 } };
+			const Transformer2D camera{ Mat3x2::Identity(),Transformer2D::Target::SetCamera };
+			const Transformer2D local{ Mat3x2::Translate(-rect.pos),Transformer2D::Target::SetLocal };
+
+			m_child->draw(rect);
+		}
+
+		//マルチサンプルのテクスチャを、表示できるテクスチャにまとめる
+		Graphics2D::Flush();
+		m_texture.resolve();
+
+		ClearPaintDirty(*m_child);
+		m_cacheValid = true;
+	}
+
+	//-----------------------------------------------
+	//  RectUI
+	//-----------------------------------------------
+
+	void RectUI::onDraw(const RectF&)const
+	{
+		Painter::DrawRect(getRect(), m_color);
+	}
+
+	bool RectUI::needsUpdate()const
+	{
+		return false;
+	}
+
+	bool RectUI::isPaintActive()const
+	{
+		return false;
+	}
+
+	SizeF RectUI::onGetSize()const
+	{
+		return m_size;
+	}
+
+	void RectUI::onReconcile(UIElement& source)
+	{
+		const auto& rect = static_cast<const RectUI&>(source);
+		setColor(rect.m_color);
+		setSize(rect.m_size);
+	}
+
+	//-----------------------------------------------
+	//  TextUI
+	//-----------------------------------------------
+
+	void TextUI::onDraw(const RectF&)const
+	{
+		const RectF rect = getRect();
+		const double lineHeight = m_font.height() * (m_fontSize / (double)m_font.fontSize());
+
+		//測ったときの折り返し位置で、行ごとに描く(毎フレーム折り返し直さない)
+		const Array<DrawableText>& lineTexts = getLineTexts(getWrappedLines(rect.w));
+		for (size_t i = 0; i < lineTexts.size(); ++i)
+		{
+			Painter::DrawTextAt(lineTexts[i], m_textStyle, m_fontSize, (rect.pos + Vec2{ 0, lineHeight * i }), m_color);
+		}
+	}
+
+	bool TextUI::needsUpdate()const
+	{
+		return false;
+	}
+
+	bool TextUI::isPaintActive()const
+	{
+		return false;
+	}
+
+	SizeF TextUI::onGetSize()const
+	{
+		return m_regionSize;
+	}
+
+	double TextUI::onGetY(double x)const
+	{
+		return getWrappedLines(x).height;
+	}
+
+	void TextUI::shape()
+	{
+		m_drawableText = m_font(m_text);
+
+		//折り返し位置を文字列の位置で持てるように、グリフクラスタで整形する
+		m_glyphs.clear();
+		for (const auto& cluster : m_font.getGlyphClusters(m_text))
+		{
+			m_glyphs << ShapedGlyph{ cluster.xAdvance,cluster.pos,((cluster.pos < m_text.size()) && (m_text[cluster.pos] == U'\n')) };
+		}
+
+		updateRegion();
+	}
+
+	void TextUI::updateRegion()
+	{
+		m_regionSize = m_drawableText.region(m_fontSize).size;
+		m_wrappedLinesCache.clear();
+	}
+
+	const TextUI::WrappedLines& TextUI::getWrappedLines(double width)const
+	{
+		for (const auto& lines : m_wrappedLinesCache)
+		{
+			if (lines.width == width)
+			{
+				return lines;
+			}
+		}
+
+		if (WrappedLinesCacheCapacity <= m_wrappedLinesCache.size())
+		{
+			m_wrappedLinesCache.erase(m_wrappedLinesCache.begin());
+		}
+
+		const double scale = m_fontSize / (double)m_font.fontSize();
+		const double fontHeight = m_font.height() * scale;
+
+		WrappedLines lines{ .width = width };
+		size_t lineCount = 1;
+		double penX = 0;
+
+		//折り返さない大きさに収まるなら、改行文字でだけ行を分ける
+		const bool fits = (m_regionSize.x <= width);
+
+		for (size_t i = 0; i < m_glyphs.size(); ++i)
+		{
+			const ShapedGlyph& glyph = m_glyphs[i];
+
+			if (glyph.newLine)
+			{
+				penX = 0;
+				lines.breaks << (glyph.pos + 1);
+				++lineCount;
+				continue;
+			}
+
+			const double xAdvance = glyph.xAdvance * scale;
+
+			//同じ文字から作られたグリフの間や、行の先頭では折り返さない
+			const bool clusterBegin = ((i == 0) || (m_glyphs[i - 1].pos != glyph.pos));
+
+			if ((not fits) && clusterBegin && (0 < penX) && (width + WrapEpsilon < penX + xAdvance))
+			{
+				penX = 0;
+				lines.breaks << glyph.pos;
+				++lineCount;
+			}
+
+			penX += xAdvance;
 		}
 
-		const RectF newRect
-		{
-			area.x + (area.w - size.x) * relative.x.relative,
-			area.y + (area.h - size.y) * relative.y.relative,
-			size
-		};
+		lines.height = lineCount * fontHeight;
+
+		m_wrappedLinesCache << std::move(lines);
+		return m_wrappedLinesCache.back();
+	}
 
-		if (m_changeSizeFlg)
+	const Array<DrawableText>& TextUI::getLineTexts(const WrappedLines& lines)const
+	{
+		if (lines.lineTexts)
 		{
-			m_changeSizeFlg = false;
+			return lines.lineTexts;
 		}
-		else if (m_rect.size == newRect.size)
+
+		size_t begin = 0;
+		for (size_t i = 0; i <= lines.breaks.size(); ++i)
 		{
-			if (m_rect.pos != newRect.pos)
+			const size_t end = Clamp((i < lines.breaks.size()) ? lines.breaks[i] : m_text.size(), begin, m_text.size());
+
+			//改行文字は行に含めない
+			size_t last = end;
+			if (begin < last && m_text[last - 1] == U'\n')
 			{
-				moveBy(newRect.pos - m_rect.pos);
+				--last;
 			}
-			return;
+
+			lines.lineTexts << m_font(m_text.substr(begin, last - begin));
+			begin = end;
 		}
 
-		m_rect = newRect;
-		onBuild();
+		return lines.lineTexts;
 	}
 
-	void UIElement::onMoveBy(const Vec2&)
+	ColorF TextUI::DefaultColor = Palette::Black;
+	AssetName TextUI::DefaultFontName;
+
+	void TextUI::onReconcile(UIElement& source)
 	{
-		onBuild();
+		const auto& text = static_cast<const TextUI&>(source);
+		setTextStyle(text.m_textStyle);
+		setColor(text.m_color);
+		setFont(text.m_font);
+		setText(text.m_text);
+		setFontSize(text.m_fontSize);
 	}
 
-	void UIElement::onUpdate() {}
-
-	void UIElement::onDraw(const RectF&)const {}
+	//-----------------------------------------------
+	//  TextureUI
+	//-----------------------------------------------
 
-	void UIElement::onBuild() {}
+	bool TextureUI::onMouseOver()const
+	{
+		const RectF rect = getRect();
+		const SizeF magnification = rect.size / m_texture.size;
+		const double r = Min(magnification.x, magnification.y);
+		return m_texture.scaled(r).regionAt(rect.center()).mouseOver();
+	}
 
-	double UIElement::onGetX(double)const
+	void TextureUI::onDraw(const RectF&)const
 	{
-		return onGetSize().x;
+		const RectF rect = getRect();
+		const SizeF magnification = rect.size / m_texture.size;
+		const double r = Min(magnification.x, magnification.y);
+		Painter::DrawTexture(m_texture.scaled(r), rect.center(), m_color);
 	}
 
-	double UIElement::onGetY(double)const
+	bool TextureUI::needsUpdate()const
 	{
-		return onGetSize().y;
+		return false;
 	}
 
-	bool UIElement::onMouseOver()const
+	bool TextureUI::isPaintActive()const
 	{
-		return getRect().mouseOver();
+		return false;
 	}
 
-	SizeF UIElement::getSize()
+	SizeF TextureUI::onGetSize()const
 	{
-		if (not m_preSize)
-		{
-			m_preSize = getSizeWithoutMargine() + m_margine.getSize();
-		}
-		return *m_preSize;
+		return m_texture.size;
 	}
 
-	double UIElement::getX(double y)
+	void TextureUI::onReconcile(UIElement& source)
 	{
-		if (not m_preX)
-		{
-			m_preX = { getXWithoutMargine(y - m_margine.getVertical()) + m_margine.getHorizontal() ,y };
-		}
-		else if (m_preX->y != y)
-		{
-			m_preX = { getXWithoutMargine(y - m_margine.getVertical()) + m_margine.getHorizontal() ,y };
-		}
-		return m_preX->x;
+		const auto& texture = static_cast<const TextureUI&>(source);
+		setColor(texture.m_color);
+		setTexture(texture.m_texture);
 	}
 
-	double UIElement::getY(double x)
+	//-----------------------------------------------
+	//  FrameStats
+	//-----------------------------------------------
+
+	FrameStats& detail::CurrentFrameStats()
 	{
-		if (not m_preY)
-		{
-			m_preY = { x,getYWithoutMargine(x - m_margine.getHorizontal()) + m_margine.getVertical() };
-		}
-		else if (m_preY->x != x)
-		{
-			m_preY = { x,getYWithoutMargine(x - m_margine.getHorizontal()) + m_margine.getVertical() };
-		}
-		return m_preY->y;
+		return g_frameStats;
 	}
 
-	SizeF UIElement::getSizeWithoutMargine()const
+	//-----------------------------------------------
+	//  FlatTree
+	//-----------------------------------------------
+
+	FlatTree::~FlatTree()
 	{
-		if (m_width)
-		{
-			return SizeF{ m_width.value() ,m_height ? m_height.value() : onGetY(m_width.value()) };
-		}
-		else if (m_height)
-		{
-			return SizeF{ onGetX(m_height.value()),m_height.value() };
-		}
-		else
-		{
-			return onGetSize();
-		}
+		detach(0, m_nodes.size());
 	}
 
-	double UIElement::getXWithoutMargine(double y)const
+	void FlatTree::rebuild(UIElement& root)
 	{
-		if (m_width)
-		{
-			return m_width.value();
-		}
-		else
-		{
-			return onGetX(m_height ? m_height.value() : y);
-		}
+		clear();
+		append(&root, NoParent, 0);
 	}
 
-	double UIElement::getYWithoutMargine(double x)const
+	bool FlatTree::update(UIElement& subtree)
 	{
-		if (m_height)
-		{
-			return m_height.value();
-		}
-		else
+		const Optional<size_t> found = indexOf(subtree);
+
+		if (not found)
 		{
-			return onGetY(m_width ? m_width.value() : x);
+			return false;
 		}
-	}
-
 
-	////-----------------------------------------------
-	////  NoneUI
-	////-----------------------------------------------
+		const uint32 index = static_cast<uint32>(*found);
+		const uint32 oldEnd = m_subtreeEnds[index];
 
-	void NoneUI::onDraw(const RectF&)const
-	{
-		RectF rect = getRect();
-		rect.drawFrame(2, Palette::Red);
-		Line{ rect.tl(),rect.br() }.draw(2, Palette::Red);
-		Line{ rect.tr(),rect.bl() }.draw(2, Palette::Red);
-	}
+		FlatTree part;
+		part.append(&subtree, m_parents[index], index);
 
-	SizeF NoneUI::onGetSize()const
-	{
-		return SizeF{ 20,20 };
-	}
+		const uint32 newEnd = index + static_cast<uint32>(part.size());
 
-	//-----------------------------------------------
-	//  ChildrenContainer
-	//-----------------------------------------------
+		//新しい部分木に残ったUIはpartに並べ直されているので、ここで外れるのは部分木から取り除かれたUIだけ
+		detach(index, oldEnd);
 
-	void ChildrenContainer::onMoveBy(const Vec2& pos)
-	{
-		for (const auto& child : m_children)
+		if (newEnd == oldEnd)
 		{
-			child->moveBy(pos);
+			//形が変わっていなければ、その範囲を書き換えるだけ
+			std::copy(part.m_nodes.begin(), part.m_nodes.end(), m_nodes.begin() + index);
+			std::copy(part.m_hitTestRects.begin(), part.m_hitTestRects.end(), m_hitTestRects.begin() + index);
+			std::copy(part.m_parents.begin(), part.m_parents.end(), m_parents.begin() + index);
+			std::copy(part.m_subtreeEnds.begin(), part.m_subtreeEnds.end(), m_subtreeEnds.begin() + index);
+			std::copy(part.m_flags.begin(), part.m_flags.end(), m_flags.begin() + index);
+			attach(index, newEnd);
+			return true;
 		}
-	}
 
-	void ChildrenContainer::onUpdate()
-	{
-		for (size_t i = 0; i < m_children.size(); ++i)
+		const auto replace = [&](auto& array, const auto& values)
+			{
+				array.erase(array.begin() + index, array.begin() + oldEnd);
+				array.insert(array.begin() + index, values.begin(), values.end());
+			};
+		replace(m_nodes, part.m_nodes);
+		replace(m_hitTestRects, part.m_hitTestRects);
+		replace(m_parents, part.m_parents);
+		replace(m_subtreeEnds, part.m_subtreeEnds);
+		replace(m_flags, part.m_flags);
+		attach(index, newEnd);
+
+		//後ろにずれた分と、祖先の部分木の終わりを直す
+		const auto shift = [&](uint32 value) { return (oldEnd <= value) ? static_cast<uint32>(value + newEnd - oldEnd) : value; };
+
+		for (size_t i = 0; i < index; ++i)
 		{
-			m_children[m_children.size() - 1 - i]->update();
+			m_subtreeEnds[i] = shift(m_subtreeEnds[i]);
 		}
-	}
 
-	void ChildrenContainer::onDraw(const RectF& drawingArea)const
-	{
-		for (const auto& child : m_children)
+		for (size_t i = newEnd; i < m_nodes.size(); ++i)
 		{
-			if (drawingArea.intersects(child->getMargineRect()))
+			//破棄されたUIの位置は空いている
+			if (m_nodes[i])
 			{
-				child->draw(drawingArea);
+				m_nodes[i]->m_flatIndex = static_cast<uint32>(i);
+			}
+			m_subtreeEnds[i] = shift(m_subtreeEnds[i]);
+			if (m_parents[i] != NoParent)
+			{
+				m_parents[i] = shift(m_parents[i]);
 			}
 		}
-	}
 
-	//-----------------------------------------------
-	//  ChildContainer
-	//-----------------------------------------------
+		return true;
+	}
 
-	void ChildContainer::onBuild()
+	void FlatTree::clear()noexcept
 	{
-		m_child->build(getRect());
+		detach(0, m_nodes.size());
+		m_nodes.clear();
+		m_hitTestRects.clear();
+		m_parents.clear();
+		m_subtreeEnds.clear();
+		m_flags.clear();
 	}
 
-	SizeF ChildContainer::onGetSize()const
+	size_t FlatTree::size()const noexcept
 	{
-		return m_child->getSize();
+		return m_nodes.size();
 	}
 
-	double ChildContainer::onGetX(double y)const
+	Optional<size_t> FlatTree::indexOf(const UIElement& element)const noexcept
 	{
-		return m_child->getX(y);
+		const size_t index = element.m_flatIndex;
+
+		if (index < m_nodes.size() && m_nodes[index] == &element)
+		{
+			return index;
+		}
+
+		return none;
 	}
 
-	double ChildContainer::onGetY(double x)const
+	UIElement* FlatTree::getNode(size_t index)const noexcept
 	{
-		return m_child->getY(x);
+		return m_nodes[index];
 	}
 
-	void ChildContainer::onMoveBy(const Vec2& pos)
+	const Array<RectF>& FlatTree::getHitTestRects()const noexcept
 	{
-		m_child->moveBy(pos);
+		return m_hitTestRects;
 	}
 
-	//-----------------------------------------------
-	//  PanelBase
-	//-----------------------------------------------
-
-	void PanelBase::onBuild()
+	const Array<uint32>& FlatTree::getParents()const noexcept
 	{
-		RectF area = getRect();
-		area.x += m_padding.left;
-		area.y += m_padding.top;
-		area.w -= m_padding.getHorizontal();
-		area.h -= m_padding.getVertical();
-		m_child->build(area);
+		return m_parents;
 	}
 
-	SizeF PanelBase::onGetSize()const
+	const Array<uint32>& FlatTree::getSubtreeEnds()const noexcept
 	{
-		return m_child->getSize() + m_padding.getSize();
+		return m_subtreeEnds;
 	}
 
-	double PanelBase::onGetX(double y)const
+	const Array<uint8>& FlatTree::getFlags()const noexcept
 	{
-		return m_child->getX(y - m_padding.getVertical()) + m_padding.getHorizontal();
+		return m_flags;
 	}
 
-	double PanelBase::onGetY(double x)const
+	UIElement* FlatTree::hitTest(const Vec2& pos)const noexcept
 	{
-		return m_child->getY(x - m_padding.getHorizontal()) + m_padding.getVertical();
+		//後に並んでいるものほど手前に描かれる
+		for (size_t i = m_hitTestRects.size(); i-- > 0;)
+		{
+			if (m_nodes[i] && m_hitTestRects[i].contains(pos))
+			{
+				return m_nodes[i];
+			}
+		}
+
+		return nullptr;
 	}
 
-	//-----------------------------------------------
-	//  Row
-	//-----------------------------------------------
-	double Row::onGetX(double y)const
+	void FlatTree::append(UIElement* element, uint32 parent, uint32 offset)
 	{
-		return onGetMain(y);
+		const uint32 index = offset + static_cast<uint32>(m_nodes.size());
+		const bool boundary = element->isHitTestIndexBoundary();
+
+		element->m_flatIndex = index;
+		element->m_flatTree = this;
+		m_nodes << element;
+		m_hitTestRects << element->getHitTestRect();
+		m_parents << parent;
+		m_subtreeEnds << 0;
+		m_flags << static_cast<uint8>((element->m_clickable ? Clickable : 0) | (boundary ? IndexBoundary : 0));
+
+		if (not boundary)
+		{
+			element->forEachChild([&](UIElement* child) { append(child, index, offset); });
+		}
+
+		m_subtreeEnds[index - offset] = offset + static_cast<uint32>(m_nodes.size());
 	}
 
-	double Row::onGetY(double x)const
+	void FlatTree::attach(size_t begin, size_t end)noexcept
 	{
-		return onGetCross(x);
+		for (size_t i = begin; i < end; ++i)
+		{
+			m_nodes[i]->m_flatTree = this;
+		}
 	}
 
-	//-----------------------------------------------
-	//  Column
-	//-----------------------------------------------
-	double Column::onGetX(double y)const
+	void FlatTree::detach(size_t begin, size_t end)noexcept
 	{
-		return onGetCross(y);
+		for (size_t i = begin; i < end; ++i)
+		{
+			UIElement* const node = m_nodes[i];
+			if (node && node->m_flatTree == this)
+			{
+				node->m_flatTree = nullptr;
+			}
+		}
 	}
 
-	double Column::onGetY(double x)const
+	void FlatTree::release(const UIElement& element)noexcept
 	{
-		return onGetMain(x);
+		if (const auto index = indexOf(element))
+		{
+			m_nodes[*index] = nullptr;
+		}
 	}
 
 	//-----------------------------------------------
-	//  StackUI
+	//  HitTestGrid
 	//-----------------------------------------------
 
-	SizeF StackUI::onGetSize()const
+	void HitTestGrid::rebuild(const FlatTree& tree, const RectF& area)
 	{
-		SizeF max{};
-		for (auto& child : m_children)
+		m_id = ++g_hitTestIndexCount;
+		m_destroyedCount = g_hitTestIndexedDestroyed;
+		m_area = area;
+		m_columns = Max<size_t>(static_cast<size_t>(std::ceil(area.w / CellSize)), 1);
+		m_rows = Max<size_t>(static_cast<size_t>(std::ceil(area.h / CellSize)), 1);
+
+		m_tree = &tree;
+		m_entryCount = 0;
+		m_staleEntryCount = 0;
+
+		m_cells.resize(m_columns * m_rows);
+		for (auto& cell : m_cells)
 		{
-			const SizeF size = child->getSize();
-			max.x = Max(max.x, size.x);
-			max.y = Max(max.y, size.y);
+			cell.clear();
 		}
-		return max;
+
+		insertRange(tree, 0, tree.size());
+
+		m_valid = true;
 	}
 
-	double StackUI::onGetX(double y)const
+	void HitTestGrid::update(const FlatTree& tree, const UIElement& subtree)
 	{
-		double max = 0;
-		for (auto& child : m_children)
+		if (m_tree != &tree)
 		{
-			max = Max(max, child->getX(y));
+			return;
 		}
-		return max;
-	}
 
-	double StackUI::onGetY(double x)const
-	{
-		double max = 0;
-		for (auto& child : m_children)
+		//並んでいない部分木は、常に詳しく調べられるのでそのままでよい
+		const Optional<size_t> index = tree.indexOf(subtree);
+		if (not index)
 		{
-			max = Max(max, child->getY(x));
+			return;
 		}
-		return max;
-	}
 
-	void StackUI::onBuild()
-	{
-		for (auto& child : m_children)
+		insertRange(tree, *index, tree.getSubtreeEnds()[*index]);
+
+		//古い登録が増えすぎたり、登録したUIが破棄されていたら作り直す
+		if (not m_valid || m_destroyedCount != g_hitTestIndexedDestroyed || m_entryCount < m_staleEntryCount * 2)
 		{
-			child->build(getRect());
+			rebuild(tree, m_area);
 		}
 	}
 
-	//-----------------------------------------------
-	//  SimpleDialog
-	//-----------------------------------------------
+	void HitTestGrid::invalidate()noexcept
+	{
+		m_valid = false;
+	}
 
-	void SimpleDialog::onUpdate()
+	void HitTestGrid::mark(const Vec2& pos)
 	{
-		m_transition.update(not m_close);
+		//登録したUIが破棄されていたら、格子の中身は使えない
+		if (not m_valid || m_destroyedCount != g_hitTestIndexedDestroyed)
+		{
+			m_valid = false;
+			g_activeHitTestIndex = 0;
+			return;
+		}
 
-		if (m_transition.isOne())
+		g_activeHitTestIndex = m_id;
+		++g_hitTestFrame;
+
+		const Cell& cell = m_cells[getRow(pos.y) * m_columns + getColumn(pos.x)];
+		const size_t count = cell.elements.size();
+		const float x = static_cast<float>(pos.x), y = static_cast<float>(pos.y);
+		size_t i = 0;
+
+#ifdef BUNCHOUI_HIT_TEST_SSE2
+		const __m128 px = _mm_set1_ps(x), py = _mm_set1_ps(y);
+
+		for (; i + 4 <= count; i += 4)
 		{
-			childUpdate();
-			if (updateFunc)
+			const __m128 inside = _mm_and_ps(
+				_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(cell.lefts.data() + i), px), _mm_cmple_ps(px, _mm_loadu_ps(cell.rights.data() + i))),
+				_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(cell.tops.data() + i), py), _mm_cmple_ps(py, _mm_loadu_ps(cell.bottoms.data() + i))));
+
+			if (const int mask = _mm_movemask_ps(inside))
 			{
-				updateFunc(this);
+				for (size_t lane = 0; lane < 4; ++lane)
+				{
+					if (mask & (1 << lane))
+					{
+						cell.elements[i + lane]->m_hitTestFrame = g_hitTestFrame;
+					}
+				}
 			}
+		}
+#endif
 
-			if (erasable && not m_child->mouseOver() && MouseL.down())
+		for (; i < count; ++i)
+		{
+			if (cell.lefts[i] <= x && x <= cell.rights[i] && cell.tops[i] <= y && y <= cell.bottoms[i])
 			{
-				close();
+				cell.elements[i]->m_hitTestFrame = g_hitTestFrame;
 			}
 		}
+	}
 
-		if (m_close && m_transition.isZero())
+	void HitTestGrid::insert(UIElement* element, const RectF& rect)
+	{
+		if (element->m_hitTestIndexId == m_id)
 		{
-			if (auto ptr = getParent<ChildrenContainer>())
+			if (element->m_hitTestRect == rect)
 			{
-				ptr->removeChild(this);
+				return;
+			}
+
+			//前の升目の登録は残るが、onMouseOverで弾かれるので問題ない
+			++m_staleEntryCount;
+		}
+
+		element->m_hitTestIndexId = m_id;
+		element->m_hitTestRect = rect;
+		++m_entryCount;
+
+		//範囲からはみ出たUIは端の升目に入れる
+		const size_t left = getColumn(rect.x), right = getColumn(rect.rightX());
+		const size_t top = getRow(rect.y), bottom = getRow(rect.bottomY());
+
+		for (size_t row = top; row <= bottom; ++row)
+		{
+			for (size_t column = left; column <= right; ++column)
+			{
+				m_cells[row * m_columns + column].add(element, rect);
 			}
 		}
 	}
 
-	void SimpleDialog::onDraw(const RectF& drawArea)const
+	void HitTestGrid::insertRange(const FlatTree& tree, size_t begin, size_t end)
 	{
-		ScopedColorMul2D mul{ AlphaF(m_transition.value()) };
-		getRect().draw(backgroundColor);
-		childDraw(drawArea);
+		const Array<RectF>& rects = tree.getHitTestRects();
+
+		for (size_t i = begin; i < end; ++i)
+		{
+			if (UIElement* element = tree.getNode(i))
+			{
+				insert(element, rects[i]);
+			}
+		}
+	}
+
+	void HitTestGrid::Cell::clear()noexcept
+	{
+		elements.clear();
+		lefts.clear();
+		tops.clear();
+		rights.clear();
+		bottoms.clear();
+	}
+
+	void HitTestGrid::Cell::add(UIElement* element, const RectF& rect)
+	{
+		constexpr float Inf = std::numeric_limits<float>::infinity();
+
+		//floatにしたときに範囲が狭くならないよう、外側に丸める
+		elements << element;
+		lefts << std::nextafter(static_cast<float>(rect.x), -Inf);
+		tops << std::nextafter(static_cast<float>(rect.y), -Inf);
+		rights << std::nextafter(static_cast<float>(rect.rightX()), Inf);
+		bottoms << std::nextafter(static_cast<float>(rect.bottomY()), Inf);
+	}
+
+	size_t HitTestGrid::getColumn(double x)const noexcept
+	{
+		return static_cast<size_t>(Clamp(std::floor((x - m_area.x) / CellSize), 0.0, static_cast<double>(m_columns - 1)));
+	}
+
+	size_t HitTestGrid::getRow(double y)const noexcept
+	{
+		return static_cast<size_t>(Clamp(std::floor((y - m_area.y) / CellSize), 0.0, static_cast<double>(m_rows - 1)));
 	}
 
 	//-----------------------------------------------
-	//  RectPanel
+	//  UIManager
 	//-----------------------------------------------
 
-	void RectPanel::onUpdate()
+	MouseInput MouseInput::Current()
 	{
-		childUpdate();
+		return { .pos = Cursor::PosF(),.leftDown = MouseL.down(),.leftUp = MouseL.up(),.wheel = Mouse::Wheel(),.leftPressed = MouseL.pressed() };
 	}
 
-	void RectPanel::onDraw(const RectF& drawingArea)const
+	MouseInput detail::CurrentMouseInput()
 	{
-		getRoundRect().draw(color);
-		childDraw(drawingArea);
+		return g_updatingInput ? *g_updatingInput : MouseInput::Current();
 	}
 
-	bool RectPanel::onMouseOver()const
+	UIManager::UIManager(const RectF& rect)
+		: m_rect{ rect }
 	{
-		return getRoundRect().mouseOver();
+		g_managers << this;
 	}
 
-	//-----------------------------------------------
-	//  SimpleButton
-	//-----------------------------------------------
+	UIManager::~UIManager()
+	{
+		g_managers.remove(this);
+	}
 
-	void SimpleButton::onUpdate()
+	void UIManager::update(const RectF& rect)
 	{
-		childUpdate();
+		update(rect, MouseInput::Current());
 	}
 
-	void SimpleButton::onDraw(const RectF& drawingArea)const
+	void UIManager::update(const RectF& rect, const MouseInput& input)
 	{
-		const Transformer2D transform{ pressed() ? Mat3x2::Scale(0.95,getRect().center()) : Mat3x2::Identity() };
-		getRoundRect().draw((mouseOver() && clickable) ? mouseOverColor : color);
-		childDraw(drawingArea);
-		if (not clickable)
+		beginFrameStats();
+
+		if (m_rect != rect)
 		{
-			getRoundRect().draw(ColorF{ 0,0.5 });
+			m_rect = rect;
+			m_stackUI->changeSize();
 		}
-	}
 
-	bool SimpleButton::onMouseOver()const
-	{
-		return getRoundRect().mouseOver();
-	}
+		//前のフレームのupdate～drawの間の変更を反映してから、カーソルの判定をする
+		layout();
 
-	//-----------------------------------------------
-	//  SimpleSlider
-	//-----------------------------------------------
+# ifdef BUNCHOUI_ENABLE_STATS
+		const Stopwatch stopwatch{ StartImmediately::Yes };
+# endif
 
-	bool SimpleSlider::onMouseOver()const
-	{
-		const RectF rect = getRect();
-		return RectF{ Arg::center = rect.center(),rect.w, KnobR * 2 }.mouseOver();
+		//UIが調べるカーソルの座標を、渡された座標にずらす
+		const Transformer2D cursor{ Mat3x2::Translate(Cursor::PosF() - input.pos),TransformCursor::Yes };
+
+		CursorSystem::SetCaptureOneFrame(false);
+		CursorSystem::SetWheelCaptureOneFrame(false);
+		CursorSystem::SetWheelHCaptureOneFrame(false);
+
+		m_hitTestGrid.mark(input.pos);
+
+		//UIが読むボタンやホイールの状態も、渡された入力にする
+		const Vec2 inputDelta = m_previousInputPos ? (input.pos - *m_previousInputPos) : Vec2{ 0,0 };
+		m_previousInputPos = input.pos;
+
+		//カーソルの下のUIは、このUIManagerの更新の間だけ記録する
+		m_hoverTarget = nullptr;
+		{
+			UIManager* const previous = std::exchange(g_updatingManager, this);
+			const MouseInput* const previousInput = std::exchange(g_updatingInput, &input);
+			const Vec2 previousDelta = std::exchange(g_updatingInputDelta, inputDelta);
+			m_stackUI->update();
+			g_updatingManager = previous;
+			g_updatingInput = previousInput;
+			g_updatingInputDelta = previousDelta;
+		}
+
+		dispatchEvents(input);
+
+# ifdef BUNCHOUI_ENABLE_STATS
+		g_frameStats.updateTime += stopwatch.msF();
+# endif
 	}
 
-	void SimpleSlider::onUpdate()
+	void UIManager::layout()const
 	{
-		m_sliderReleased = false;
+# ifdef BUNCHOUI_ENABLE_STATS
+		const Stopwatch stopwatch{ StartImmediately::Yes };
+# endif
 
-		if (enabled && isAvailableCursor())
+		const bool changeSize = m_stackUI->isChangeSize();
+
+		if (changeSize)
 		{
-			const RectF rect = getRect();
-			const RectF hitBox{ Arg::center = rect.center(),rect.w, KnobR * 2 };
+			m_stackUI->build(m_rect);
+		}
 
-			if (hasMouseCapture())
+		//大きさが変わらないUIの中だけの変更は、その部分木だけ再配置する
+		Array<UIElement*> relayoutRoots;
+		if (m_stackUI->m_descendantRelayoutFlg)
+		{
+			m_stackUI->relayout(relayoutRoots);
+		}
+
+		//位置や形だけが変わったUIも、当たり判定の登録をし直す
+		Array<UIElement*> hitTestChanges;
+		if (m_stackUI->m_hitTestDirty || m_stackUI->m_descendantHitTestDirty)
+		{
+			m_stackUI->collectHitTestChanges(hitTestChanges);
+		}
+
+		if (changeSize)
+		{
+			m_flatTree.rebuild(*m_stackUI);
+			m_hitTestGrid.rebuild(m_flatTree, m_rect);
+		}
+		else
+		{
+			for (UIElement* root : relayoutRoots)
 			{
-				CursorSystem::RequestHandStyle();
-				const double w = rect.w - KnobR * 2;
-				value = Clamp(Cursor::PosF().x - (rect.x + KnobR), 0.0, w) / w;
-				if (MouseL.up())
+				if (m_flatTree.update(*root))
 				{
-					m_sliderReleased = true;
-					setMouseCapture(false);
+					m_hitTestGrid.update(m_flatTree, *root);
 				}
 			}
-			else {
-				if (hitBox.mouseOver())
-				{
-					CursorSystem::RequestHandStyle();
-				}
-				if (hitBox.leftClicked())
+
+			for (UIElement* element : hitTestChanges)
+			{
+				if (m_flatTree.update(*element))
 				{
-					setMouseCapture(true);
+					m_hitTestGrid.update(m_flatTree, *element);
 				}
 			}
 		}
+
+# ifdef BUNCHOUI_ENABLE_STATS
+		g_frameStats.layoutTime += stopwatch.msF();
+# endif
 	}
 
-	void SimpleSlider::onDraw(const RectF&)const
+	void UIManager::draw()const
 	{
-		const RectF rect = getRect();
-		const double w = rect.w - KnobR * 2;
-		RectF{ Arg::center = rect.center(),w,BarHeight }.draw(Palette::Gray);
-		const double length = value * w;
-		RectF{ Arg::center = rect.leftCenter() + Vec2{length / 2 + KnobR,0},length,BarHeight }.draw(color);
-		if (not enabled)
+		//updateのイベントのハンドラなどで変わったUIを並べ直す
+		layout();
+
+# ifdef BUNCHOUI_ENABLE_STATS
+		const Stopwatch stopwatch{ StartImmediately::Yes };
+# endif
+
+		if (m_damageRedraw)
+		{
+			drawDamage();
+		}
+		else if (m_drawReplay)
 		{
-			RectF{ Arg::center = rect.center(),w,BarHeight }.draw(ColorF{ 0,0.4 });
+			recordDraw();
 		}
-		Circle{ length + rect.x + KnobR, rect.center().y ,KnobR }.draw(enabled ? Palette::White : Palette::Lightgray);
-		if (not enabled)
+		else
 		{
-			Circle{ length + rect.x + KnobR, rect.center().y ,KnobR }.draw(ColorF{ 0,0.4 });
+			m_stackUI->draw(m_rect);
 		}
+
+# ifdef BUNCHOUI_ENABLE_STATS
+		g_frameStats.drawTime += stopwatch.msF();
+# endif
 	}
 
-	SizeF SimpleSlider::onGetSize()const
+	void UIManager::recordDraw()const
 	{
-		return { 150 + KnobR * 2,KnobR * 2 };
-	}
+		//何も変わっていなければ、前のフレームの記録をそのまま使う
+		if (m_stackUI->m_paintDirty || m_drawList.isEmpty() || m_stackUI->m_drawArea != m_rect)
+		{
+			std::swap(m_drawList, m_previousDrawList);
+			m_drawList.clear();
 
-	//-----------------------------------------------
-	//  SimpleScrollbar
-	//-----------------------------------------------
+			g_drawFrame = ++m_drawFrame;
+			g_previousDrawList = &m_previousDrawList;
+			{
+				const Painter::ScopedRecording recording{ m_drawList };
+				m_stackUI->draw(m_rect);
+			}
+			g_previousDrawList = nullptr;
+		}
+		else
+		{
+			BUNCHOUI_COUNT_STATS(drawReplays);
+		}
 
-	void SimpleScrollbar::onUpdate()
-	{
-		RectF view = getRect();
+		if (g_drawList)
+		{
+			g_drawList->append(m_drawList);
+		}
+		else
+		{
+			m_drawList.submit();
+		}
+	}
 
-		bool changeValueFlg = false;
+	void UIManager::drawDamage()const
+	{
+		const Size size{ static_cast<int32>(std::ceil(m_rect.w)),static_cast<int32>(std::ceil(m_rect.h)) };
 
-		if (isScroll())
+		if (size.x <= 0 || size.y <= 0)
 		{
-			view.w -= ScrollbarWidth;
+			return;
+		}
 
-			if (isAvailableCursor())
-			{
+		m_damageRects.clear();
+		m_stackUI->collectDamage(m_damageRects);
 
-				if (hasMouseCapture())
-				{
-					if (MouseL.up())
-					{
-						setMouseCapture(false);
-					}
+		//領域が変わったら、全体を描き直す
+		if (m_backbufferRect != m_rect)
+		{
+			m_backbuffer = MSRenderTexture{ size,ColorF{ 0.0,0.0 } };
+			m_backbufferRect = m_rect;
+			m_damageRects = { m_rect };
+		}
 
-					const double space = view.h * (1 - getRate());
-					double oldValue = m_value;
-					m_value = Clamp(m_value + Cursor::DeltaF().y / space, 0.0, 1.0);
+		MergeDamageRects(m_damageRects, m_rect, MaxDamageRects);
 
-					if (oldValue != m_value)
-					{
-						changeValueFlg = true;
-					}
-				}
-				else {
+# ifdef BUNCHOUI_ENABLE_STATS
+		g_frameStats.damageRects += m_damageRects.size();
+# endif
 
-					if (getBarRoundRect().mouseOver())
-					{
-						CursorSystem::RequestHandStyle();
-					}
+		if (m_damageRects)
+		{
+			//記録中でも、テクスチャへはすぐに描く
+			const Painter::ScopedImmediate immediate;
+			const ScopedRenderTarget2D target{ m_backbuffer };
 
-					if (getBarRoundRect().leftClicked())
-					{
-						setMouseCapture(true);
-					}
-				}
+			//透明なテクスチャに乗算済みアルファで描き、表示するときもそのまま重ねる
+			const ScopedRenderStates2D states{ Painter::PremultipliedTargetBlend(),RasterizerState::Default2D };
 
-			}
-		}
+			//前の絵を消すときは、描く色で置き換える
+			BlendState replace = BlendState::Default2D;
+			replace.src = Blend::One;
+			replace.dst = Blend::Zero;
+			replace.srcAlpha = Blend::One;
+			replace.dstAlpha = Blend::Zero;
 
+			const ScopedColorMul2D colorMul{ ColorF{ 1.0 } };
+			const Transformer2D camera{ Mat3x2::Identity(),Transformer2D::Target::SetCamera };
+			const Transformer2D local{ Mat3x2::Translate(-m_rect.pos),Transformer2D::Target::SetLocal };
 
-		if (view.mouseOver())
-		{
-			childUpdate();
-		}
-		else {
-			bool capture = false;
-			//枠の外のカーソルに反応しないようにする
-			if (not CursorSystem::IsCaptured())
+			for (const RectF& rect : m_damageRects)
 			{
-				setMouseCapture(true);
-				capture = true;
-			}
+				const Painter::ScopedClip clip{ rect };
 
-			childUpdate();
+				{
+					const ScopedRenderStates2D clear{ replace };
+					rect.draw(ColorF{ 0.0,0.0 });
+				}
 
-			if (capture)
-			{
-				setMouseCapture(false);
+				//範囲と重ならない子供は描かない
+				m_stackUI->draw(rect);
 			}
 		}
 
-		if (isScroll() && mouseOver() && not CursorSystem::IsWheelCaptured() && Mouse::Wheel()) {
-			m_value = Clamp(m_value + Mouse::Wheel() / (m_childHeight - view.h) * speed, 0.0, 1.0);
-			CursorSystem::SetWheelCaptureOneFrame(true);
-			changeValueFlg = true;
+		if (m_damageRects)
+		{
+			Graphics2D::Flush();
+			m_backbuffer.resolve();
 		}
 
-		if (changeValueFlg) {
-			const double pos = m_value * (m_childHeight - view.h);
-			m_child->setPos(view.pos + Vec2{ 0,-pos });
-		}
+		UIElement::ClearPaintDirty(*m_stackUI);
 
+		Painter::DrawPremultipliedTexture(TextureRegion{ m_backbuffer }, m_rect.pos + Vec2{ size.x / 2.0,size.y / 2.0 }, ColorF{ 1.0 });
 	}
 
-	void SimpleScrollbar::onDraw(const RectF&)const
+	void UIManager::draw(DrawList& drawList)const
 	{
-		RectF view = getRect();
-		if (isScroll())
-		{
-			view.w -= ScrollbarWidth;
-		}
+		const Painter::ScopedRecording recording{ drawList };
+		draw();
+	}
 
+	PhaseTimes UIManager::getPhaseTimePercentile(double percentile)const
+	{
+		if (not m_statsHistory)
 		{
-			const Rect oldScissorRect = Graphics2D::GetScissorRect();
-			Graphics2D::SetScissorRect(view.asRect());
-			RasterizerState rs = RasterizerState::Default2D;
-			rs.scissorEnable = true;
-			const ScopedRenderStates2D rasterizer{ rs };
-			m_child->draw(view);
-			Graphics2D::SetScissorRect(oldScissorRect);
+			return {};
 		}
 
-		if (isScroll())
+		const size_t index = static_cast<size_t>(Clamp(percentile / 100.0, 0.0, 1.0) * (m_statsHistory.size() - 1) + 0.5);
+
+		const auto getPercentile = [&](auto getTime)
+			{
+				Array<double> times(m_statsHistory.size());
+				for (size_t i = 0; i < times.size(); ++i)
+				{
+					times[i] = getTime(m_statsHistory[i]);
+				}
+				std::nth_element(times.begin(), times.begin() + index, times.end());
+				return times[index];
+			};
+
+		return
 		{
-			getBackBarRoundRect().draw(ColorF{ 0.9 });
-			getBarRoundRect().draw(hasMouseCapture() ? ColorF{ 0.3 } : ColorF{ 0.5 });
-		}
+			.update = getPercentile([](const FrameStats& stats) { return stats.updateTime; }),
+			.layout = getPercentile([](const FrameStats& stats) { return stats.layoutTime; }),
+			.draw = getPercentile([](const FrameStats& stats) { return stats.drawTime; })
+		};
 	}
 
-	void SimpleScrollbar::onBuild()
+	void UIManager::beginFrameStats()const
 	{
-		RectF rect = getRect();
-		m_childHeight = m_child->getY(rect.w);
+# ifdef BUNCHOUI_ENABLE_STATS
+		m_frameStats = std::exchange(g_frameStats, FrameStats{});
 
-		if (isScroll())
+		if (m_statsHistory.size() < StatsHistorySize)
 		{
-			m_childHeight = m_child->getY(rect.w - ScrollbarWidth);
-			m_child->build({ rect.pos,rect.w - ScrollbarWidth,Max(m_childHeight,rect.h) });
+			m_statsHistory << m_frameStats;
 		}
 		else
 		{
-			m_child->build({ rect.pos,rect.w, Max(m_childHeight,rect.h) });
-			m_value = 0;
+			m_statsHistory[m_statsHistoryIndex] = m_frameStats;
+			m_statsHistoryIndex = (m_statsHistoryIndex + 1) % StatsHistorySize;
 		}
-
-		double pos = m_value * (m_childHeight - rect.h);
-		m_child->setPos(rect.pos + Vec2{ 0,-pos });
-	}
-
-	double SimpleScrollbar::onGetX(double y)const
-	{
-		return m_child->getX(y) + ScrollbarWidth;//スクロールバーの分
-	}
-
-	//-----------------------------------------------
-	//  RectUI
-	//-----------------------------------------------
-
-	void RectUI::onDraw(const RectF&)const
-	{
-		getRect().draw(color);
+# endif
 	}
 
-	SizeF RectUI::onGetSize()const
+	void UIManager::dispatchEvents(const MouseInput& input)
 	{
-		return m_size;
-	}
+		const Vec2& pos = input.pos;
 
-	//-----------------------------------------------
-	//  TextUI
-	//-----------------------------------------------
-
-	void TextUI::onDraw(const RectF&)const
-	{
-		RectF rect = getRect();
-		//https://github.com/Siv3D/siv8/issues/57 の対策
-		rect.w = Max(rect.w + 0.1, 42.5);
-		m_font(m_text).draw(textStyle, m_fontSize, rect, color);
-	}
+		for (size_t i = 0; i < m_pendingEvents.size(); ++i)
+		{
+			if (UIElement* target = m_pendingEvents[i].target)
+			{
+				UIEvent event{ .type = m_pendingEvents[i].type,.target = target,.pos = pos };
+				UIElement::DispatchEvent(event, false);
+			}
+		}
+		m_pendingEvents.clear();
 
-	SizeF TextUI::onGetSize()const
-	{
-		return m_font(m_text).region(m_fontSize).size;
-	}
+		//ハンドラの中でUIが消されると対象がnullptrになるので、毎回読み直す
+		if (input.leftDown)
+		{
+			m_pressTarget = m_hoverTarget;
 
-	double TextUI::onGetY(double x)const
-	{
-		const double scale = m_fontSize / (double)m_font.fontSize();
-		const Array<Glyph> glyphs = m_font.getGlyphs(m_text);
-		const double fontHeight = m_font.height() * scale;
-		Vec2 penPos{ 0,0 };
+			if (m_hoverTarget)
+			{
+				UIEvent event{ .type = UIEventType::Press,.target = m_hoverTarget,.pos = pos };
+				UIElement::DispatchEvent(event, true);
+			}
+		}
 
-		for (const auto& glyph : glyphs)
+		if (input.leftUp)
 		{
-			if (glyph.codePoint == U'\n')
+			if (m_hoverTarget)
 			{
-				penPos.x = 0;
-				penPos.y += fontHeight;
-				continue;
+				UIEvent event{ .type = UIEventType::Release,.target = m_hoverTarget,.pos = pos };
+				UIElement::DispatchEvent(event, true);
 			}
 
-			if (x < penPos.x + glyph.xAdvance * scale)
+			//押したUIと離したUIが違っても、共通の祖先(ボタンの中の文字と余白など)ならクリックとする
+			UIElement* const pressTarget = std::exchange(m_pressTarget, nullptr);
+			if (UIElement* target = CommonAncestor(m_hoverTarget, pressTarget))
 			{
-				penPos.x = 0;
-				penPos.y += fontHeight;
+				UIEvent event{ .type = UIEventType::Click,.target = target,.pos = pos };
+				UIElement::DispatchEvent(event, true);
 			}
-
-			penPos.x += glyph.xAdvance * scale;
 		}
 
-		return penPos.y + fontHeight;
-	}
-
-	ColorF TextUI::DefaultColor = Palette::Black;
-	AssetName TextUI::DefaultFontName;
-
-	//-----------------------------------------------
-	//  TextureUI
-	//-----------------------------------------------
-
-	bool TextureUI::onMouseOver()const
-	{
-		const RectF rect = getRect();
-		const SizeF magnification = rect.size / m_texture.size;
-		const double r = Min(magnification.x, magnification.y);
-		return m_texture.scaled(r).regionAt(rect.center()).mouseOver();
-	}
-
-	void TextureUI::onDraw(const RectF&)const
-	{
-		const RectF rect = getRect();
-		const SizeF magnification = rect.size / m_texture.size;
-		const double r = Min(magnification.x, magnification.y);
-		m_texture.scaled(r).drawAt(rect.center(), color);
-	}
-
-	SizeF TextureUI::onGetSize()const
-	{
-		return m_texture.size;
+		if (input.wheel != 0 && m_hoverTarget)
+		{
+			UIEvent event{ .type = UIEventType::Wheel,.target = m_hoverTarget,.pos = pos,.wheel = input.wheel };
+			UIElement::DispatchEvent(event, true);
+		}
 	}
 
-	//-----------------------------------------------
-	//  UIManager
-	//-----------------------------------------------
-
-	void UIManager::update(const RectF& rect)
+	void UIManager::releaseElement(const UIElement* element)noexcept
 	{
-		CursorSystem::SetCaptureOneFrame(false);
-		CursorSystem::SetWheelCaptureOneFrame(false);
-		CursorSystem::SetWheelHCaptureOneFrame(false);
-
-		bool changeSizeFlg = false;
+		if (m_hoverTarget == element)
+		{
+			m_hoverTarget = nullptr;
+		}
 
-		m_stackUI->update();
+		if (m_pressTarget == element)
+		{
+			m_pressTarget = nullptr;
+		}
 
-		if (m_rect != rect)
+		for (PendingEvent& event : m_pendingEvents)
 		{
-			m_rect = rect;
-			m_stackUI->changeSize();
+			if (event.target == element)
+			{
+				event.target = nullptr;
+			}
 		}
 	}
 }
@@ -1,5 +1,8 @@
 ﻿#pragma once
 
+//BunchoUI.cppをビルドするときにBUNCHOUI_ENABLE_STATS を定義すると、UIManagerからフレームごとの統計を取得できる
+//(ヘッダーの内容は変わらないので、BunchoUIを使う側で定義する必要はない)
+
 namespace BunchoUI
 {
 	namespace CursorSystem
@@ -44,6 +47,378 @@ namespace BunchoUI
 		void RequestHandStyle();
 	}
 
+	///@brief UIのメモリを大きさごとにまとめて確保するプール
+	///@remark プールはプログラム全体で1つで、UIManagerごとには分かれていない
+	///@remark スレッドセーフではないので、UIはメインスレッドだけで作って破棄する
+	namespace NodePool
+	{
+		///@brief プールの統計
+		struct Stats
+		{
+			///@brief 確保した回数
+			size_t allocations = 0;
+
+			///@brief 解放した回数
+			size_t deallocations = 0;
+
+			///@brief プールではなくヒープから確保した回数
+			size_t heapAllocations = 0;
+
+			///@brief 確保中のUIの数
+			size_t liveNodes = 0;
+
+			///@brief プールが持っているメモリの塊の数
+			size_t chunks = 0;
+
+			///@brief プールが持っているメモリの合計
+			size_t reservedBytes = 0;
+		};
+
+		///@brief プールを使うかを設定する
+		///@param enabled true:プールを使う false:通常のヒープを使う
+		///@remark 既に確保したUIには影響しない
+		void SetEnabled(bool enabled);
+
+		///@brief プールを使うかを取得する
+		///@return プールを使うか
+		[[nodiscard]]
+		bool IsEnabled();
+
+		///@brief メモリを確保する
+		///@param size 確保する大きさ
+		///@param pooled プールから確保するか(falseなら通常のヒープから確保する)
+		///@return 確保したメモリ
+		[[nodiscard]]
+		void* Allocate(size_t size, bool pooled = true);
+
+		///@brief メモリを解放する
+		///@param p Allocateで確保したメモリ
+		///@param size 確保したときの大きさ
+		///@param pooled 確保したときのpooled
+		void Deallocate(void* p, size_t size, bool pooled = true);
+
+		///@brief 確保中のUIが1つも無い大きさのプールだけ、メモリを解放する
+		///@remark 部分木を捨てたときにその分をまとめて解放するものではない。同じ大きさのUIが1つでも残っていると、その大きさのメモリは解放されない
+		///@remark 画面を丸ごと捨てた後などに、余ったメモリを減らすために使う
+		void TrimIdle();
+
+		///@brief 統計を取得する
+		///@return 統計
+		[[nodiscard]]
+		Stats GetStats();
+
+		///@brief 確保・解放の回数をリセットする
+		void ResetStats();
+	}
+
+	///@brief NodePoolからメモリを確保するアロケータ
+	///@tparam Type 確保する型
+	template<typename Type>
+	struct NodeAllocator
+	{
+		using value_type = Type;
+
+		///@brief プールから確保したか(解放するときに使う)
+		bool pooled = NodePool::IsEnabled();
+
+		NodeAllocator()noexcept = default;
+
+		template<typename Other>
+		NodeAllocator(const NodeAllocator<Other>& other)noexcept;
+
+		[[nodiscard]]
+		Type* allocate(size_t n);
+
+		void deallocate(Type* p, size_t n)noexcept;
+
+		template<typename Other>
+		bool operator==(const NodeAllocator<Other>& other)const noexcept;
+	};
+
+	///@brief NodePoolを使ってUIを作る
+	///@tparam Type 作るUIの型
+	///@param args コンストラクタの引数
+	///@return 作ったUI
+	template<typename Type, typename... Args>
+	[[nodiscard]]
+	std::shared_ptr<Type>MakeNode(Args&&... args);
+
+	///@brief 描画命令の種類
+	enum class DrawCommandType : uint8
+	{
+		Rect,
+		RectFrame,
+		RoundRect,
+		Circle,
+		Line,
+		Text,
+		TextAt,
+		Texture,
+		PremultipliedTexture,
+		PushClip,
+		PopClip,
+		PushTransform,
+		PopTransform,
+		PushColorMul,
+		PopColorMul,
+	};
+
+	///@brief 1つの描画命令
+	struct DrawCommand
+	{
+		DrawCommandType type = DrawCommandType::Rect;
+
+		///@brief 図形・文字・切り抜きの範囲
+		///@remark Circleは中心(x,y)と半径(w)、Lineは始点(x,y)と終点(w,h)、TextAtは左上(x,y)、Texture・PremultipliedTextureは中心(x,y)
+		RectF rect{};
+
+		///@brief 角の丸み(RoundRect)・線の太さ(RectFrame,Line)・文字の大きさ(Text,TextAt)
+		double value = 0.0;
+
+		///@brief 色(PushColorMulでは掛ける色)
+		ColorF color{ 1.0 };
+
+		///@brief 文字・テクスチャ・変換の番号
+		uint32 resource = 0;
+	};
+
+	///@brief 描画命令を記録するリスト
+	///@remark Painterの関数で描いたものを記録し、submitでまとめて描画する
+	class DrawList
+	{
+	public:
+
+		void addRect(const RectF& rect, const ColorF& color);
+
+		void addRectFrame(const RectF& rect, double thickness, const ColorF& color);
+
+		void addRoundRect(const RoundRect& roundRect, const ColorF& color);
+
+		void addCircle(const Circle& circle, const ColorF& color);
+
+		void addLine(const Line& line, double thickness, const ColorF& color);
+
+		void addText(const DrawableText& text, const TextStyle& textStyle, double fontSize, const RectF& rect, const ColorF& color);
+
+		void addTextAt(const DrawableText& text, const TextStyle& textStyle, double fontSize, const Vec2& pos, const ColorF& color);
+
+		void addTexture(const TextureRegion& texture, const Vec2& center, const ColorF& color);
+
+		void addPremultipliedTexture(const TextureRegion& texture, const Vec2& center, const ColorF& color);
+
+		///@brief 切り抜く範囲を追加する(popClipまで有効)
+		///@param rect 切り抜く範囲(その時点の座標変換を掛ける前の座標)
+		void pushClip(const RectF& rect);
+
+		void popClip();
+
+		void pushTransform(const Mat3x2& transform);
+
+		void popTransform();
+
+		void pushColorMul(const ColorF& color);
+
+		void popColorMul();
+
+		///@brief 別のリストの命令を後ろに追加する
+		void append(const DrawList& other);
+
+		///@brief 別のリストの[begin, end)の命令を後ろに追加する
+		///@remark 範囲の中でPushとPopが対応している必要がある
+		void append(const DrawList& other, size_t begin, size_t end);
+
+		///@brief 記録した命令を描画する
+		void submit()const;
+
+		void clear()noexcept;
+
+		[[nodiscard]]
+		bool isEmpty()const noexcept;
+
+		[[nodiscard]]
+		size_t size()const noexcept;
+
+		[[nodiscard]]
+		const Array<DrawCommand>& getCommands()const noexcept;
+
+		///@brief 指定した種類の命令の数を数える
+		[[nodiscard]]
+		size_t count(DrawCommandType type)const noexcept;
+
+		///@brief 描画する命令(切り抜き・変換・色の変更以外)の数
+		[[nodiscard]]
+		size_t getDrawCallCount()const noexcept;
+
+		[[nodiscard]]
+		const DrawableText& getText(const DrawCommand& command)const;
+
+		[[nodiscard]]
+		const TextStyle& getTextStyle(const DrawCommand& command)const;
+
+		[[nodiscard]]
+		const TextureRegion& getTexture(const DrawCommand& command)const;
+
+		[[nodiscard]]
+		const Mat3x2& getTransform(const DrawCommand& command)const;
+
+	private:
+
+		struct TextRun
+		{
+			DrawableText text;
+
+			TextStyle textStyle;
+		};
+
+		Array<DrawCommand> m_commands;
+
+		Array<TextRun> m_texts;
+
+		Array<TextureRegion> m_textures;
+
+		Array<Mat3x2> m_transforms;
+
+		/// @brief index番目から、対応するPop命令まで描画する
+		/// @return 次に描画する位置
+		size_t submitRange(size_t index)const;
+	};
+
+	///@brief UIの描画に使う関数
+	///@remark 記録中はDrawListに記録し、そうでなければすぐに描画する
+	///@remark 自作のUIもこれを使って描けば、記録・再生できる
+	namespace Painter
+	{
+		void DrawRect(const RectF& rect, const ColorF& color);
+
+		void DrawRectFrame(const RectF& rect, double thickness, const ColorF& color);
+
+		void DrawRoundRect(const RoundRect& roundRect, const ColorF& color);
+
+		void DrawCircle(const Circle& circle, const ColorF& color);
+
+		void DrawLine(const Line& line, double thickness, const ColorF& color);
+
+		void DrawTextInRect(const DrawableText& text, const TextStyle& textStyle, double fontSize, const RectF& rect, const ColorF& color);
+
+		///@brief 折り返さずに、左上の座標に文字を描く
+		void DrawTextAt(const DrawableText& text, const TextStyle& textStyle, double fontSize, const Vec2& pos, const ColorF& color);
+
+		void DrawTexture(const TextureRegion& texture, const Vec2& center, const ColorF& color);
+
+		///@brief 乗算済みアルファのテクスチャを描く
+		///@remark PremultipliedTargetBlendで描いたRenderTextureを表示するときに使う
+		void DrawPremultipliedTexture(const TextureRegion& texture, const Vec2& center, const ColorF& color);
+
+		///@brief 透明なRenderTextureに、乗算済みアルファで重ねて描くためのブレンド
+		[[nodiscard]]
+		BlendState PremultipliedTargetBlend();
+
+		///@brief 記録中か調べる
+		[[nodiscard]]
+		bool IsRecording()noexcept;
+
+		///@brief スコープの間、記録中でもすぐに描画する
+		///@remark RenderTextureに描くときなどに使う
+		class ScopedImmediate
+		{
+		public:
+
+			ScopedImmediate()noexcept;
+
+			~ScopedImmediate();
+
+			ScopedImmediate(const ScopedImmediate&) = delete;
+
+			ScopedImmediate& operator=(const ScopedImmediate&) = delete;
+
+		private:
+
+			DrawList* m_previous = nullptr;
+		};
+
+		///@brief スコープの間、描画をDrawListに記録する
+		class ScopedRecording
+		{
+		public:
+
+			explicit ScopedRecording(DrawList& drawList)noexcept;
+
+			~ScopedRecording();
+
+			ScopedRecording(const ScopedRecording&) = delete;
+
+			ScopedRecording& operator=(const ScopedRecording&) = delete;
+
+		private:
+
+			DrawList* m_previous = nullptr;
+		};
+
+		///@brief スコープの間、描画を長方形で切り抜く
+		///@remark 範囲はその時点の座標変換を掛けて画面上の長方形に直す
+		///@remark 外側のScopedClipとは重なる部分だけを残し、範囲が変わらないときは描画の状態を変えない
+		class ScopedClip
+		{
+		public:
+
+			explicit ScopedClip(const RectF& rect);
+
+			~ScopedClip();
+
+			ScopedClip(const ScopedClip&) = delete;
+
+			ScopedClip& operator=(const ScopedClip&) = delete;
+
+		private:
+
+			DrawList* m_drawList = nullptr;
+
+			Rect m_oldScissorRect{};
+
+			Optional<ScopedRenderStates2D> m_rasterizer;
+		};
+
+		///@brief スコープの間、座標変換を掛ける
+		class ScopedTransform
+		{
+		public:
+
+			explicit ScopedTransform(const Mat3x2& transform);
+
+			~ScopedTransform();
+
+			ScopedTransform(const ScopedTransform&) = delete;
+
+			ScopedTransform& operator=(const ScopedTransform&) = delete;
+
+		private:
+
+			DrawList* m_drawList = nullptr;
+
+			Optional<Transformer2D> m_transformer;
+		};
+
+		///@brief スコープの間、色を掛ける
+		class ScopedColorMul
+		{
+		public:
+
+			explicit ScopedColorMul(const ColorF& color);
+
+			~ScopedColorMul();
+
+			ScopedColorMul(const ScopedColorMul&) = delete;
+
+			ScopedColorMul& operator=(const ScopedColorMul&) = delete;
+
+		private:
+
+			DrawList* m_drawList = nullptr;
+
+			Optional<ScopedColorMul2D> m_colorMul;
+		};
+	}
+
 	///@brief 周りのUIとの間隔を表すクラス
 	struct Margin
 	{
@@ -74,6 +449,9 @@ namespace BunchoUI
 		/// @brief 水平方向の合計を計算
 		/// @return right + left
 		constexpr double getHorizontal()const noexcept;
+
+		[[nodiscard]]
+		constexpr bool operator==(const Margin&)const noexcept = default;
 	};
 
 	///@brief 内側のUIとの間隔を表すクラス
@@ -111,6 +489,9 @@ namespace BunchoUI
 
 		bool stretch = false;
 		double relative = 0.5;
+
+		[[nodiscard]]
+		constexpr bool operator==(const Axis&)const noexcept = default;
 	};
 
 	///@brief xとy軸の相対座標(0～1)を表すクラス
@@ -150,14 +531,143 @@ namespace BunchoUI
 
 		[[nodiscard]]
 		static Relative Left()noexcept;
+
+		[[nodiscard]]
+		constexpr bool operator==(const Relative&)const noexcept = default;
+	};
+
+	///@brief UIの大きさの最小値と最大値を表すクラス
+	///@remark 最小値と最大値が同じ軸は、その長さに決まっている
+	struct BoxConstraints
+	{
+		SizeF min{ 0,0 };
+		SizeF max{ Math::Inf,Math::Inf };
+
+		///@brief 制限なし
+		[[nodiscard]]
+		static constexpr BoxConstraints Unbounded()noexcept;
+
+		///@brief 大きさが決まっている
+		[[nodiscard]]
+		static constexpr BoxConstraints Tight(const SizeF& size)noexcept;
+
+		///@brief 横幅だけが決まっている
+		[[nodiscard]]
+		static constexpr BoxConstraints TightWidth(double width)noexcept;
+
+		///@brief 縦幅だけが決まっている
+		[[nodiscard]]
+		static constexpr BoxConstraints TightHeight(double height)noexcept;
+
+		///@brief 最大値だけが決まっている
+		[[nodiscard]]
+		static constexpr BoxConstraints Loose(const SizeF& size)noexcept;
+
+		[[nodiscard]]
+		constexpr bool hasTightWidth()const noexcept;
+
+		[[nodiscard]]
+		constexpr bool hasTightHeight()const noexcept;
+
+		///@brief 周りの空間の分だけ小さくした制約を返す
+		///@param size 周りの空間の合計
+		[[nodiscard]]
+		BoxConstraints deflate(const SizeF& size)const noexcept;
+
+		///@brief 大きさを制約の範囲に収める
+		[[nodiscard]]
+		SizeF constrain(const SizeF& size)const noexcept;
+
+		[[nodiscard]]
+		constexpr bool operator==(const BoxConstraints&)const noexcept = default;
+	};
+
+	///@brief UIの変更の種類
+	///@remark 組み合わせて使える
+	enum class Invalidation : uint8
+	{
+		None = 0,
+
+		///@brief 大きさが変わりうる(再配置が必要)
+		Layout = 1 << 0,
+
+		///@brief 大きさを変えずに位置だけが変わった
+		Position = 1 << 1,
+
+		///@brief 見た目だけが変わった(描き直しが必要)
+		Paint = 1 << 2,
+
+		///@brief 当たり判定の形が変わった
+		HitTest = 1 << 3,
+	};
+
+	[[nodiscard]]
+	constexpr Invalidation operator|(Invalidation a, Invalidation b)noexcept;
+
+	[[nodiscard]]
+	constexpr Invalidation operator&(Invalidation a, Invalidation b)noexcept;
+
+	constexpr Invalidation& operator|=(Invalidation& a, Invalidation b)noexcept;
+
+	class UIElement;
+
+	class FlatTree;
+
+	///@brief UIに送られるイベントの種類
+	enum class UIEventType : uint8
+	{
+		///@brief 左ボタンが押されて、同じUIの上で離された
+		Click,
+
+		///@brief 左ボタンが押された
+		Press,
+
+		///@brief 左ボタンが離された
+		Release,
+
+		///@brief マウスが触れ始めた(親へは伝わらない)
+		Enter,
+
+		///@brief マウスが離れた(親へは伝わらない)
+		Leave,
+
+		///@brief ホイールが回された
+		Wheel,
+	};
+
+	///@brief UIに送られるイベント
+	struct UIEvent
+	{
+		UIEventType type = UIEventType::Click;
+
+		///@brief イベントが起きた、一番手前で深いUI
+		///@remark ハンドラの中で消されたUIを指していることがある
+		UIElement* target = nullptr;
+
+		///@brief ハンドラを呼んでいるUI
+		UIElement* currentTarget = nullptr;
+
+		///@brief カーソルの座標
+		Vec2 pos{};
+
+		///@brief ホイールの回転量(Wheelのときだけ)
+		double wheel = 0;
+
+		///@brief 伝えるのを止めたか
+		bool stopped = false;
+
+		///@brief これより先のUIへ伝えるのを止める
+		///@remark 同じUIの残りのハンドラは呼ばれる
+		void stopPropagation()noexcept;
 	};
 
+	///@brief イベントを受け取る関数
+	using UIEventHandler = std::function<void(UIEvent&)>;
+
 	///@brief すべてのUIの基底クラス
 	class UIElement
 	{
 	public:
-		/// @brief クリック可能か
-		bool clickable = false;
 
 		UIElement() = default;
 
@@ -179,6 +689,27 @@ namespace BunchoUI
 		/// @return サイズが変わったか
 		bool isChangeSize()const noexcept;
 
+		/// @brief 見た目だけが変わったことを通知する
+		/// @remark 自作のUIで、描画に使うメンバを書き換えたときに呼ぶ(描画の再生やRepaintBoundaryで使う)
+		void changePaint()noexcept;
+
+		/// @brief 変更を通知する
+		/// @param invalidation 変更の種類
+		/// @remark 種類ごとに必要な分だけ、再配置・描き直し・当たり判定の登録し直しが行われる
+		void invalidate(Invalidation invalidation)noexcept;
+
+		/// @brief まだ反映されていない変更の種類を取得する
+		/// @return 自身と子孫の変更の種類
+		[[nodiscard]]
+		Invalidation getInvalidation()const noexcept;
+
+		/// @brief クリック可能か調べる
+		[[nodiscard]]
+		bool isClickable()const noexcept;
+
+		/// @brief クリック可能かを設定する
+		void setClickable(bool clickable)noexcept;
+
 		/// @brief UIの更新を行う
 		void update();
 
@@ -189,6 +720,7 @@ namespace BunchoUI
 		/// @brief UIがクリックされたか調べる
 		/// @return クリックされたか
 		/// @remark clickableがfalseのときは常にfalse
+		/// @remark 毎フレーム調べる代わりに、addEventListenerやParameterのonClickで呼ばれる関数を登録できる
 		[[nodiscard]]
 		bool clicked()const noexcept;
 
@@ -202,28 +734,50 @@ namespace BunchoUI
 		/// @return 触れているか
 		bool mouseOver()const noexcept;
 
+		/// @brief イベントを受け取る関数を登録する
+		/// @param type イベントの種類
+		/// @param handler 呼ぶ関数
+		/// @param capture trueなら子孫に伝わる前(キャプチャ段階)に呼ぶ
+		/// @remark Click・Press・Releaseは、clickableがtrueのときだけ呼ばれる
+		/// @remark イベントはUIManager::updateの最後にまとめて送られるので、ハンドラの中でUIの木を書き換えてよい
+		void addEventListener(UIEventType type, const UIEventHandler& handler, bool capture = false);
+
+		/// @brief クリックされたときに呼ぶ関数を登録する
+		/// @param onClick 呼ぶ関数(空なら何もしない)
+		void addClickListener(const std::function<void()>& onClick);
+
+		/// @brief 登録した関数をすべて外す
+		void clearEventListeners()noexcept;
+
 		/// @brief UIを再配置する
 		/// @param rect 配置する長方形
 		/// @param parentRelative relativeが決まっていないときの相対座標
 		void build(const RectF& rect, const Relative& parentRelative = Relative::Center());
 
+		/// @brief 制約の中でのUIの大きさを計算する
+		/// @param constraints 大きさの制約(マージンを含む)
+		/// @return 大きさ
+		/// @remark マージンを含む　同じ制約の結果は、大きさが変わるまで覚えておく
+		[[nodiscard]]
+		SizeF measure(const BoxConstraints& constraints);
+
 		/// @brief UIのデフォルトの大きさを計算する
 		/// @return デフォルトの大きさ
-		/// @remark マージンを含む
+		/// @remark マージンを含む　measure(BoxConstraints::Unbounded())と同じ
 		[[nodiscard]]
 		SizeF getSize();
 
 		/// @brief 縦幅が決まっているときの横幅を計算する
 		/// @param x 縦幅
 		/// @return 横幅
-		/// @remark マージンを含む
+		/// @remark マージンを含む　measure(BoxConstraints::TightHeight(y)).xと同じ
 		[[nodiscard]]
 		double getX(double y);
 
 		/// @brief 横幅が決まっているときの縦幅を計算する
 		/// @param x 横幅
 		/// @return 縦幅
-		/// @remark マージンを含む
+		/// @remark マージンを含む　measure(BoxConstraints::TightWidth(x)).yと同じ
 		[[nodiscard]]
 		double getY(double x);
 
@@ -290,6 +844,54 @@ namespace BunchoUI
 
 		void setParent(UIElement* parent);
 
+		/// @brief 差分を反映するときに、同じUIを探すためのキーを設定する
+		/// @param key キー(空なら並び順で探す)
+		void setKey(StringView key);
+
+		[[nodiscard]]
+		const String& getKey()const noexcept;
+
+		/// @brief 新しく作ったUIとの差分を、自身に反映する
+		/// @param source 反映する内容を持つUI
+		/// @return 反映できたか(型やキーが違うときはfalse)
+		/// @remark 変わった設定だけを反映するので、キャッシュや状態(スクロール位置など)は残る
+		bool reconcile(UIElement& source);
+
+		/// @brief 子供のUIを順番に処理する
+		/// @param func 子供ごとに呼ばれる関数
+		virtual void forEachChild(const std::function<void(UIElement*)>& func);
+
+		/// @brief 大きさの計算のキャッシュの統計
+		struct MeasureStats
+		{
+			/// @brief キャッシュから返した回数
+			size_t hits = 0;
+
+			/// @brief 計算し直した回数
+			size_t misses = 0;
+		};
+
+		/// @brief getSize・getX・getYのキャッシュの統計を取得する
+		/// @return 統計
+		[[nodiscard]]
+		static MeasureStats GetMeasureStats()noexcept;
+
+		/// @brief getSize・getX・getYのキャッシュの統計をリセットする
+		static void ResetMeasureStats()noexcept;
+
+		/// @brief 大きさが変わったことの親への通知を、CommitTransactionまでまとめる
+		/// @remark 入れ子にできる　基本はUIManager::Transactionを使う
+		static void BeginTransaction()noexcept;
+
+		/// @brief まとめていた親への通知を行う
+		/// @remark 一番外側のCommitTransactionで通知する
+		static void CommitTransaction();
+
+		/// @brief 親への通知をまとめている最中か調べる
+		/// @return まとめている最中か
+		[[nodiscard]]
+		static bool IsInTransaction()noexcept;
+
 	protected:
 
 		/// @brief UIに使用できる長方形を取得する
@@ -297,10 +899,19 @@ namespace BunchoUI
 		[[nodiscard]]
 		RectF getRect()const noexcept;
 
+		/// @brief 制約の中でのUIの大きさを計算する
+		/// @param constraints 大きさの制約(マージンを含まない)
+		/// @return 大きさ
+		/// @remark 子供を持つUIは、子供のmeasureに制約を渡して計算する
+		/// デフォルトではonGetSize・onGetX・onGetYを使って計算する
+		[[nodiscard]]
+		virtual SizeF onMeasure(const BoxConstraints& constraints)const;
+
 		/// @brief UIのデフォルトの大きさを計算する
 		/// @return デフォルトの大きさ
+		/// @remark onMeasureをオーバーライドしないUIのための関数　onMeasureかこちらのどちらかをオーバーライドする
 		[[nodiscard]]
-		virtual SizeF onGetSize()const = 0;
+		virtual SizeF onGetSize()const;
 
 		/// @brief UIの座標が移動されたときの処理
 		virtual void onMoveBy(const Vec2& pos);
@@ -313,6 +924,7 @@ namespace BunchoUI
 		virtual void onDraw(const RectF& drawArea)const;
 
 		/// @brief 再レイアウト時の処理
+		/// @remark getRect()の中に子供を配置する　子供の大きさはmeasureで計算したものを使う
 		virtual void onBuild();
 
 		/// @brief 縦幅が決まっているときの横幅を計算する
@@ -327,6 +939,11 @@ namespace BunchoUI
 		[[nodiscard]]
 		virtual double onGetY(double x)const;
 
+		/// @brief 子孫の見た目が変わった範囲を集める
+		/// @param rects 範囲を追加する配列
+		/// @remark 子供の座標系が違うUIは、自身の座標系に直して追加する
+		virtual void onCollectDamage(Array<RectF>& rects);
+
 		/// @brief カーソルの座標とUIが重なっているか調べる
 		/// @return 重なっているか
 		[[nodiscard]]
@@ -337,30 +954,248 @@ namespace BunchoUI
 		[[nodiscard]]
 		bool isAvailableCursor()const noexcept;
 
-	private:
-		Margin m_margine;
-		Optional<double>m_width;
-		Optional<double>m_height;
-		double m_flex = 0;
-		Optional<Relative>m_relative;
+		/// @brief カーソルとの当たり判定に使う範囲を取得する
+		/// @return onMouseOverがtrueになりうる範囲
+		/// @remark UIManagerの当たり判定の格子に登録するときに使う
+		[[nodiscard]]
+		virtual RectF getHitTestRect()const noexcept;
 
-		UIElement* m_parent = nullptr;
+		/// @brief カーソルが触れていなくても毎フレーム更新する必要があるか
+		/// @return 更新が必要ならtrue
+		/// @remark falseを返すUIだけの部分木は、カーソルが近くに無いフレームでは更新を飛ばす
+		/// @remark 既定ではtrue(自作のUIはonUpdateで何をしても動き続ける)。カーソルが触れていないときにonUpdateで何もしないUIはfalseを返すと軽くなる
+		[[nodiscard]]
+		virtual bool needsUpdate()const;
+
+		/// @brief カーソルが触れていることや時間の経過で、見た目が変わりうるか
+		/// @return 変わりうるならtrue(そのフレームと次のフレームは描き直す)
+		/// @remark 既定ではカーソルが触れている間とneedsUpdateがtrueの間。見た目がカーソルに反応しないUIはfalseを返すと、描き直す範囲が狭くなる
+		[[nodiscard]]
+		virtual bool isPaintActive()const;
+
+		/// @brief 差分を反映するときの処理(派生クラスの設定を反映する)
+		/// @param source 自身と同じ型のUI
+		virtual void onReconcile(UIElement& source);
+
+		/// @brief 子供の大きさが変わっても、自身の大きさが変わらないか
+		/// @return 変わらないならtrue(デフォルトでは横幅と縦幅が両方決まっているとき)
+		/// @remark trueのときは親に通知せず、自身の部分木だけを再配置する
+		[[nodiscard]]
+		virtual bool isRelayoutBoundary()const noexcept;
+
+		/// @brief 子供を当たり判定の格子に登録しないか
+		/// @return 子供の座標系が違う、または子供が頻繁に入れ替わる場合にtrue
+		[[nodiscard]]
+		virtual bool isHitTestIndexBoundary()const noexcept;
+
+		/// @brief 部分木の見た目が、最後にClearPaintDirtyしてから変わったか調べる
+		/// @param element 部分木の根
+		[[nodiscard]]
+		static bool IsPaintDirty(const UIElement& element)noexcept;
+
+		/// @brief 部分木の見た目が変わったという印を消す
+		/// @param element 部分木の根
+		/// @remark 部分木を丸ごと描き直したときに呼ぶ
+		static void ClearPaintDirty(UIElement& element);
+
+		/// @brief 更新中の、スクロールなどで見えている範囲を取得する
+		/// @return 見えている範囲(noneなら全体が見えている)
+		/// @remark 範囲の外にあるUIは、部分木に隠れていても更新が必要なUI(needsUpdate)が無ければ更新を飛ばす
+		[[nodiscard]]
+		static const Optional<RectF>& GetUpdateArea()noexcept;
+
+		/// @brief 前回の更新で、部分木の更新を飛ばせなかった子供の番号の範囲を取得する
+		/// @return [最初の番号, 最後の番号+1)(forEachChildの順番。空なら全員飛ばせた)
+		[[nodiscard]]
+		std::pair<size_t, size_t> getAwakeChildRange()const noexcept;
+
+	private:
+		friend class HitTestGrid;
+
+		friend class FlatTree;
+
+		friend class UIManager;
+
+		Margin m_margine;
+		Optional<double>m_width;
+		Optional<double>m_height;
+		double m_flex = 0;
+		Optional<Relative>m_relative;
+
+		String m_key;
+
+		UIElement* m_parent = nullptr;
 
 		RectF m_rect{};
 		bool m_changeSizeFlg = true;
+
+		/// @brief 親への通知をトランザクションの終わりまで待っているか
+		bool m_notifyParentDeferred = false;
+
+		/// @brief 親に通知せず、自身の部分木だけの再配置を待っているか
+		bool m_relayoutFlg = false;
+
+		/// @brief 子孫に部分木だけの再配置を待っているUIがあるか
+		bool m_descendantRelayoutFlg = false;
+
+		/// @brief 前回のbuildの引数(部分木だけを再配置するときに使う)
+		RectF m_buildRect{};
+		Relative m_buildRelative = Relative::Center();
+
+		bool m_clickable = false;
+
+		struct EventListener
+		{
+			UIEventType type;
+
+			bool capture;
+
+			UIEventHandler handler;
+		};
+
+		Array<EventListener> m_eventListeners;
+
+		/// @brief イベントを、対象の祖先から対象へ(キャプチャ)、対象から祖先へ(バブリング)伝える
+		/// @param event 送るイベント(targetを設定しておく)
+		/// @param bubbles falseなら対象だけに送る
+		static void DispatchEvent(UIEvent& event, bool bubbles);
+
+		/// @brief 送っている途中の経路のUIのハンドラを呼ぶ
+		/// @param pathIndex 経路での番号
+		/// @param event 送るイベント
+		/// @param capture キャプチャ段階のハンドラを呼ぶか
+		static void HandleEvent(size_t pathIndex, UIEvent& event, bool capture);
+
 		bool m_mouseOvered = false;
 		bool m_hasMouseCapture = false;
 		bool m_isAvailableCursor = false;
 
-		Optional<SizeF>m_preX;
-		Optional<SizeF>m_preY;
-		Optional<SizeF>m_preSize;
+		/// @brief 自身の見た目が変わり、UIManagerが描き直す範囲に加えるのを待っているか
+		bool m_damaged = true;
+
+		/// @brief 最後に描き直す範囲に加えたときの自身の範囲
+		Optional<RectF> m_damageRect;
+
+		/// @brief 見た目が変わったUIの、前と今の範囲を集めて、印を消す
+		/// @param rects 範囲を追加する配列
+		void collectDamage(Array<RectF>& rects);
+
+		/// @brief 当たり判定の形が変わり、FlatTreeと格子への登録し直しを待っているか
+		bool m_hitTestDirty = false;
+
+		/// @brief 子孫に当たり判定の登録し直しを待っているUIがあるか
+		bool m_descendantHitTestDirty = false;
+
+		/// @brief 当たり判定の形が変わったことを通知する
+		void changeHitTest()noexcept;
+
+		/// @brief 当たり判定の登録し直しを待っているUIを集めて、印を消す
+		/// @param elements 集めたUIを追加する配列
+		void collectHitTestChanges(Array<UIElement*>& elements);
+
+		/// @brief 登録されている当たり判定の格子の番号
+		uint64 m_hitTestIndexId = 0;
+
+		/// @brief カーソルの近くにあるとして印をつけられたフレーム
+		uint64 m_hitTestFrame = 0;
+
+		/// @brief 当たり判定の格子に登録したときの範囲
+		RectF m_hitTestRect{};
+
+		/// @brief FlatTreeでの番号
+		uint32 m_flatIndex = 0;
+
+		/// @brief 並べられているFlatTree(破棄されるときに自分の位置を空ける)
+		FlatTree* m_flatTree = nullptr;
+
+		/// @brief onMouseOverで詳しく調べる必要があるか
+		[[nodiscard]]
+		bool isHitTestCandidate()const noexcept;
+
+		/// @brief 部分木の更新を飛ばしてよいか(前回の更新時点)
+		bool m_sleeping = false;
+
+		/// @brief 部分木の更新を飛ばせない子供の番号の範囲(前回の更新時点)
+		uint32 m_awakeChildBegin = 0;
+		uint32 m_awakeChildEnd = UINT32_MAX;
+
+		/// @brief 部分木の当たり判定の範囲をまとめた長方形
+		RectF m_updateBounds{};
+
+		bool m_updateBoundsValid = false;
+
+		/// @brief 更新が終わった後に、次のフレームで更新を飛ばせるかを調べる
+		void updateSleepState();
+
+		/// @brief 部分木の描画が前回の記録から変わった可能性があるか
+		mutable bool m_paintDirty = true;
+
+		/// @brief 前回の更新で、マウスが触れていたか毎フレームの更新が必要だったか
+		bool m_paintActive = false;
+
+		/// @brief 最後に描画を記録したフレーム
+		mutable uint64 m_drawFrame = 0;
+
+		/// @brief 最後に描画を記録したときの、DrawListの位置と命令の数
+		mutable uint32 m_drawBegin = 0;
+		mutable uint32 m_drawLength = 0;
 
-		SizeF getSizeWithoutMargine()const;
+		/// @brief 親の記録の先頭からの位置
+		mutable uint32 m_drawOffset = 0;
 
-		double getXWithoutMargine(double y)const;
+		/// @brief 記録したときに実行中だった、親のonDrawの番号
+		mutable uint64 m_parentDrawRun = 0;
 
-		double getYWithoutMargine(double x)const;
+		/// @brief 最後に実行したonDrawの番号と、その1つ前の番号
+		mutable uint64 m_drawRun = 0;
+		mutable uint64 m_previousDrawRun = 0;
+
+		/// @brief 実行中のonDrawで使う、前のフレームでの自身の記録の位置
+		mutable Optional<uint32> m_previousDrawBegin;
+
+		/// @brief 最後に描画を記録したときの描画範囲
+		mutable RectF m_drawArea{};
+
+		/// @brief 前のフレームのDrawListでの、自身の記録の位置を探す
+		[[nodiscard]]
+		Optional<uint32> findPreviousDraw()const noexcept;
+
+		/// @brief 制約ごとの計算結果を覚えておくキャッシュ
+		/// @remark 親が違う制約で交互に問い合わせても計算し直さないように、複数の結果を持つ
+		struct MeasureCache
+		{
+			static constexpr size_t Capacity = 8;
+
+			BoxConstraints constraints[Capacity];
+			SizeF results[Capacity];
+			size_t size = 0;
+			size_t next = 0;
+
+			[[nodiscard]]
+			Optional<SizeF> find(const BoxConstraints& constraints)const noexcept;
+
+			void add(const BoxConstraints& constraints, const SizeF& result)noexcept;
+
+			void clear()noexcept;
+		};
+
+		MeasureCache m_measureCache;
+
+		/// @brief マージンを含まない制約の中での大きさを計算する
+		SizeF measureWithoutMargine(BoxConstraints constraints);
+
+		/// @brief 自身の大きさや配置の設定が変わったことを、親にも通知する
+		void changeLayout()noexcept;
+
+		/// @brief 親に大きさが変わったことを通知する
+		void notifyParent()noexcept;
+
+		/// @brief 親への通知をトランザクションの終わりまで待つ
+		void deferNotifyParent();
+
+		/// @brief 部分木だけの再配置を待っているUIを、前回と同じ範囲で再配置する
+		/// @param relayoutRoots 再配置した部分木の根を追加する配列
+		void relayout(Array<UIElement*>& relayoutRoots);
 	};
 
 	///@brief childが空のときに表示するUI
@@ -374,6 +1209,8 @@ namespace BunchoUI
 		void onDraw(const RectF&)const override;
 
 		SizeF onGetSize()const override;
+
+		bool needsUpdate()const override;
 	};
 
 	/// @brief 複数の子供を持つクラスの基底クラス
@@ -398,17 +1235,34 @@ namespace BunchoUI
 
 		void replaceChild(size_t index, const std::shared_ptr<UIElement>& newChild);
 
+		/// @brief 新しく作った子供たちとの差分を反映する
+		/// @param children 新しい子供たち
+		/// @remark キーがあればキーで、無ければ同じ位置の子供と型で照合し、照合できた子供は作り直さない
+		void reconcileChildren(const Array<std::shared_ptr<UIElement>>& children);
+
+		/// @brief 新しく作った子供との差分を反映する
+		/// @param index 子供の位置
+		/// @param child 新しい子供
+		/// @remark 型やキーが違うときはreplaceChildと同じ
+		void reconcileChild(size_t index, const std::shared_ptr<UIElement>& child);
+
 		[[nodiscard]]
 		const Array<std::shared_ptr<UIElement>>& getChildren()const;
 
+		void forEachChild(const std::function<void(UIElement*)>& func)override;
+
 	protected:
 
+		void onReconcile(UIElement& source)override;
+
 		void onMoveBy(const Vec2& pos)override;
 
 		void onUpdate()override;
 
 		void onDraw(const RectF& drawingArea)const override;
 
+		bool isPaintActive()const override;
+
 		Array<std::shared_ptr<UIElement>>m_children;
 	};
 
@@ -423,8 +1277,17 @@ namespace BunchoUI
 
 		void setChild(const std::shared_ptr<UIElement>& child);
 
+		/// @brief 新しく作った子供との差分を反映する
+		/// @param child 新しい子供
+		/// @remark 型やキーが違うときはsetChildと同じ
+		void reconcileChild(const std::shared_ptr<UIElement>& child);
+
+		void forEachChild(const std::function<void(UIElement*)>& func)override;
+
 	protected:
 
+		void onReconcile(UIElement& source)override;
+
 		std::shared_ptr<UIElement>m_child;
 
 		void onBuild()override;
@@ -439,7 +1302,10 @@ namespace BunchoUI
 
 		void childUpdate();
 
+		/// @brief 子供が描画範囲と重なるときだけ描画する
 		void childDraw(const RectF& drawingArea)const;
+
+		bool isPaintActive()const override;
 	};
 
 	/// @brief 単一の子供と、子供に対するPaddingを持つクラスの基底クラス
@@ -455,13 +1321,11 @@ namespace BunchoUI
 
 	protected:
 
-		void onBuild()override;
-
-		SizeF onGetSize()const override;
+		void onReconcile(UIElement& source)override;
 
-		double onGetX(double y)const override;
+		void onBuild()override;
 
-		double onGetY(double x)const override;
+		SizeF onMeasure(const BoxConstraints& constraints)const override;
 
 	private:
 		Padding m_padding;
@@ -496,16 +1360,39 @@ namespace BunchoUI
 
 	protected:
 
+		bool needsUpdate()const override;
+
+		void onReconcile(UIElement& source)override;
+
 		void onBuild()override;
 
-		SizeF onGetSize()const override;
+		/// @brief 見えている範囲の子供だけを更新する
+		/// @remark 隠れていても更新が必要な子供がいるときは、すべての子供を更新する
+		void onUpdate()override;
+
+		/// @brief 見える範囲の子供だけを描画する
+		void onDraw(const RectF& drawingArea)const override;
 
-		double onGetMain(double cross)const;
+		/// @brief 範囲と重なりうる子供の番号の範囲を取得する
+		/// @param area 範囲
+		/// @return [最初の番号, 最後の番号+1)
+		/// @remark 子供はメインの軸の向きに順番に並んでいるので、二分探索で探す
+		[[nodiscard]]
+		std::pair<size_t, size_t> getVisibleRange(const RectF& area)const;
 
-		double onGetCross(double main)const;
+		SizeF onMeasure(const BoxConstraints& constraints)const override;
 
 	private:
 
+		/// @brief クロスする軸の長さが決まっているときの、メインの軸の長さを計算する
+		[[nodiscard]]
+		double measureMain(double cross)const;
+
+		/// @brief メインの軸の長さが決まっているときの、クロスする軸の長さを計算する
+		/// @remark flexを持つ子供には、残りの長さを比率で分けて渡す
+		[[nodiscard]]
+		double measureCross(double main)const;
+
 		template<UIDirection direction>
 		static constexpr double& get(SizeF& size);
 
@@ -532,17 +1419,13 @@ namespace BunchoUI
 			bool clickable = false;/// @brief クリック可能か
 			Optional<Relative> relative = Relative::Stretch();/// @brief 相対座標(右寄せ、中央寄せなどを指定)
 			Array<std::shared_ptr<UIElement>> children;/// @brief 並べるUIたち
+			std::function<void()> onClick;/// @brief クリックされたときに呼ぶ関数
 		};
 
 		Row(const Parameter& para);
 
 		[[nodiscard]]
 		static std::shared_ptr<Row>Create(const Parameter& para);
-
-	protected:
-		double onGetX(double y)const override;
-
-		double onGetY(double x)const override;
 	};
 
 	/// @brief 縦に並べるUI
@@ -561,18 +1444,13 @@ namespace BunchoUI
 			bool clickable = false;/// @brief クリック可能か
 			Optional<Relative> relative = Relative::Stretch();/// @brief 相対座標(右寄せ、中央寄せなどを指定)
 			Array<std::shared_ptr<UIElement>>children;/// @brief 並べるUIたち
+			std::function<void()> onClick;/// @brief クリックされたときに呼ぶ関数
 		};
 
 		Column(const Parameter& para);
 
 		[[nodiscard]]
 		static std::shared_ptr<Column>Create(const Parameter& para);
-
-	protected:
-
-		double onGetX(double y)const override;
-
-		double onGetY(double x)const override;
 	};
 
 	/// @brief 上に重ねるUI
@@ -589,6 +1467,7 @@ namespace BunchoUI
 			bool clickable = false;/// @brief クリック可能か
 			Optional<Relative> relative = Relative::Stretch();/// @brief 相対座標(右寄せ、中央寄せなどを指定)
 			Array<std::shared_ptr<UIElement>>children;/// @brief 並べるUIたち
+			std::function<void()> onClick;/// @brief クリックされたときに呼ぶ関数
 		};
 
 		StackUI(const Parameter& para);
@@ -604,11 +1483,9 @@ namespace BunchoUI
 
 	protected:
 
-		SizeF onGetSize()const override;
-
-		double onGetX(double y)const override;
+		bool needsUpdate()const override;
 
-		double onGetY(double x)const override;
+		SizeF onMeasure(const BoxConstraints& constraints)const override;
 
 		void onBuild()override;
 	};
@@ -622,9 +1499,6 @@ namespace BunchoUI
 		/// @brief 毎フレーム実行される関数
 		std::function<void(SimpleDialog*)>updateFunc;
 
-		/// @brief ダイアログの背景の色
-		ColorF backgroundColor{ 0,0.3 };
-
 		/// @brief ダイアログ以外をクリックしたら消えるか
 		bool erasable;
 
@@ -646,15 +1520,30 @@ namespace BunchoUI
 		/// @remark 親がChildrenContainerの派生クラスでないと消せない
 		void close()noexcept;
 
+		/// @brief ダイアログの背景の色を取得する
+		[[nodiscard]]
+		ColorF getBackgroundColor()const noexcept;
+
+		/// @brief ダイアログの背景の色を設定する
+		void setBackgroundColor(const ColorF& color)noexcept;
+
 	protected:
+		void onReconcile(UIElement& source)override;
+
 		void onUpdate()override;
 
 		void onDraw(const RectF& drawArea)const override;
 
+		bool isPaintActive()const override;
+
+		bool needsUpdate()const override;
+
 	private:
 		bool m_close = false;
 		Transition m_transition;
 
+		ColorF m_backgroundColor;
+
 	};
 
 	/// @brief シンプルな長方形のパネル
@@ -662,12 +1551,6 @@ namespace BunchoUI
 	{
 	public:
 
-		/// @brief 角の丸み
-		double r;
-
-		// @brief 長方形の色
-		ColorF color;
-
 		struct Parameter
 		{
 			double r = 0;/// @brief 角の丸み
@@ -680,6 +1563,7 @@ namespace BunchoUI
 			bool clickable = false;/// @brief クリック可能か
 			Optional<Relative> relative;/// @brief 相対座標(右寄せ、中央寄せなどを指定)
 			std::shared_ptr<UIElement>child = NoneUI::Create();/// @brief 子供のUI
+			std::function<void()> onClick;/// @brief クリックされたときに呼ぶ関数
 		};
 
 		RectPanel(const Parameter& para);
@@ -687,16 +1571,38 @@ namespace BunchoUI
 		[[nodiscard]]
 		static std::shared_ptr<RectPanel>Create(const Parameter& para);
 
+		/// @brief 角の丸みを取得する
+		[[nodiscard]]
+		double getR()const noexcept;
+
+		/// @brief 角の丸みを設定する
+		void setR(double r)noexcept;
+
+		/// @brief 長方形の色を取得する
+		[[nodiscard]]
+		ColorF getColor()const noexcept;
+
+		/// @brief 長方形の色を設定する
+		void setColor(const ColorF& color)noexcept;
+
 		bool onMouseOver()const override;
 
 	protected:
 
+		bool needsUpdate()const override;
+
+		void onReconcile(UIElement& source)override;
+
 		void onUpdate()override;
 
 		void onDraw(const RectF& drawingArea)const override;
 
 	private:
 
+		double m_r;
+
+		ColorF m_color;
+
 		RoundRect getRoundRect()const noexcept;
 	};
 
@@ -705,15 +1611,6 @@ namespace BunchoUI
 	{
 	public:
 
-		/// @brief 角の丸み
-		double r;
-
-		/// @brief ボタンの色
-		ColorF color;
-
-		/// @brief マウスが触れているときの色
-		ColorF mouseOverColor;
-
 		struct Parameter
 		{
 			double r = 10;
@@ -727,6 +1624,7 @@ namespace BunchoUI
 			bool clickable = true;/// @brief クリック可能か
 			Optional<Relative> relative = none;/// @brief 相対座標(右寄せ、中央寄せなどを指定)
 			std::shared_ptr<UIElement>child = NoneUI::Create();/// @brief 子供のUI
+			std::function<void()> onClick;/// @brief クリックされたときに呼ぶ関数
 		};
 
 		SimpleButton(const Parameter& para);
@@ -734,30 +1632,55 @@ namespace BunchoUI
 		[[nodiscard]]
 		static std::shared_ptr<SimpleButton>Create(const Parameter& para);
 
+		/// @brief 角の丸みを取得する
+		[[nodiscard]]
+		double getR()const noexcept;
+
+		/// @brief 角の丸みを設定する
+		void setR(double r)noexcept;
+
+		/// @brief ボタンの色を取得する
+		[[nodiscard]]
+		ColorF getColor()const noexcept;
+
+		/// @brief ボタンの色を設定する
+		void setColor(const ColorF& color)noexcept;
+
+		/// @brief マウスが触れているときの色を取得する
+		[[nodiscard]]
+		ColorF getMouseOverColor()const noexcept;
+
+		/// @brief マウスが触れているときの色を設定する
+		void setMouseOverColor(const ColorF& color)noexcept;
+
 	protected:
 
+		void onReconcile(UIElement& source)override;
+
 		void onUpdate()override;
 
 		void onDraw(const RectF& drawingArea)const override;
 
+		bool needsUpdate()const override;
+
+		bool isPaintActive()const override;
+
 		bool onMouseOver()const override;
 
 	private:
 
+		double m_r;
+
+		ColorF m_color;
+
+		ColorF m_mouseOverColor;
+
 		RoundRect getRoundRect()const noexcept;
 	};
 
 	/// @brief シンプルなスライダー
 	class SimpleSlider :public UIElement {
 	public:
-		/// @brief スライダーの値
-		double value = 1.0;
-
-		/// @brief スライダーの色
-		ColorF color;
-
-		/// @brief スライダーが有効か
-		bool enabled;
 
 		struct Parameter
 		{
@@ -776,22 +1699,57 @@ namespace BunchoUI
 		[[nodiscard]]
 		static std::shared_ptr<SimpleSlider>Create(const Parameter& para);
 
+		/// @brief スライダーの値(0～1)を取得する
+		[[nodiscard]]
+		double getValue()const noexcept;
+
+		/// @brief スライダーの値(0～1)を設定する
+		void setValue(double value)noexcept;
+
+		/// @brief スライダーの色を取得する
+		[[nodiscard]]
+		ColorF getColor()const noexcept;
+
+		/// @brief スライダーの色を設定する
+		void setColor(const ColorF& color)noexcept;
+
+		/// @brief スライダーが有効かを取得する
+		[[nodiscard]]
+		bool isEnabled()const noexcept;
+
+		/// @brief スライダーが有効かを設定する
+		void setEnabled(bool enabled)noexcept;
+
 		/// @brief スライダーが離されたかを調べる
 		/// @return スライダーが離されたか
 		bool sliderReleased()const noexcept;
 
 	protected:
 
+		void onReconcile(UIElement& source)override;
+
 		bool onMouseOver()const override;
 
+		RectF getHitTestRect()const noexcept override;
+
+		bool needsUpdate()const override;
+
 		void onUpdate()override;
 
 		void onDraw(const RectF&)const override;
 
+		bool isPaintActive()const override;
+
 		SizeF onGetSize()const override;
 
 	private:
 
+		double m_value;
+
+		ColorF m_color;
+
+		bool m_enabled;
+
 		bool m_sliderReleased = false;
 
 		static constexpr double BarHeight = 7;
@@ -822,22 +1780,42 @@ namespace BunchoUI
 		[[nodiscard]]
 		static std::shared_ptr<SimpleScrollbar>Create(const Parameter& para);
 
+		/// @brief 子供のUIが見えている範囲を取得する
+		/// @return 子供の座標系で見えている長方形
+		[[nodiscard]]
+		RectF getVisibleRect()const noexcept;
+
 	protected:
 
+		void onReconcile(UIElement& source)override;
+
 		void onUpdate()override;
 
 		void onDraw(const RectF&)const override;
 
+		bool needsUpdate()const override;
+
+		bool isPaintActive()const override;
+
 		void onBuild()override;
 
 		double onGetX(double y)const override;
 
+		bool isHitTestIndexBoundary()const noexcept override;
+
+		/// @brief 子孫の範囲をスクロールした分ずらし、見えている部分だけを追加する
+		void onCollectDamage(Array<RectF>& rects)override;
+
 	private:
 
 		bool isScroll()const noexcept;
 
 		double getRate()const noexcept;
 
+		/// @brief 子供をスクロールさせている量を取得する
+		/// @return 子供を上にずらしている長さ
+		double getScrollPos()const noexcept;
+
 		RoundRect getBackBarRoundRect()const noexcept;
 
 		RoundRect getBarRoundRect()const noexcept;
@@ -848,109 +1826,395 @@ namespace BunchoUI
 		static constexpr double ScrollbarWidth = 20;
 	};
 
-	/// @brief 長方形を表示するのUI
-	class RectUI :public  UIElement
+	/// @brief 見えている行だけを生成・更新・描画する縦のリスト
+	/// @remark 基本、SimpleScrollbarの子供として使う
+	class VirtualColumn :public UIElement
 	{
 	public:
 
-		/// @brief 長方形の色
-		ColorF color;
+		/// @brief 行のUIを作る関数
+		using Builder = std::function<std::shared_ptr<UIElement>(size_t)>;
+
+		/// @brief 再利用する行のUIを書き換える関数
+		using Updater = std::function<void(size_t, const std::shared_ptr<UIElement>&)>;
 
 		struct Parameter
 		{
-			SizeF size = SizeF{ 50,50 };/// @brief 長方形のサイズ
-			ColorF color = Palette::White;/// @brief 長方形の色
+			size_t itemCount = 0;/// @brief 行の数
+			Builder builder;/// @brief 行のUIを作る関数
+			Updater updater = nullptr;/// @brief 再利用する行のUIを書き換える関数(設定すると見えなくなった行を再利用する)
+			Optional<double> itemHeight;/// @brief 行の高さ(設定すると固定)
+			double estimatedItemHeight = 50;/// @brief まだ作っていない行の高さの見積もり
+			size_t overscan = 2;/// @brief 見えている範囲の前後に余分に用意する行の数
+			Axis crossAxis = CrossAxis::center;/// @brief 横方向の並べ方
 			Margin margine;/// @brief 周りのUIとの間隔
 			Optional<double> width;/// @brief 横幅(設定しないと自動計算)
 			Optional<double> height;/// @brief 縦幅(設定しないと自動計算)
 			double flex = 0;/// @brief RowやColumn内での比率
-			bool clickable = false;/// @brief クリック可能か
-			Optional<Relative> relative = none;/// @brief 相対座標(右寄せ、中央寄せなどを指定)
+			Optional<Relative> relative = Relative::Stretch();/// @brief 相対座標(右寄せ、中央寄せなどを指定)
 		};
 
-		RectUI(const Parameter& para);
+		VirtualColumn(const Parameter& para);
 
 		[[nodiscard]]
-		static std::shared_ptr<RectUI>Create(const Parameter& para);
+		static std::shared_ptr<VirtualColumn>Create(const Parameter& para);
 
 		[[nodiscard]]
-		SizeF getSize()const noexcept;
+		size_t getItemCount()const noexcept;
 
-		void setSize(const SizeF& size)noexcept;
+		/// @brief 行の数を変更する
+		/// @param itemCount 行の数
+		/// @remark 表示中の行は作り直される
+		void setItemCount(size_t itemCount);
+
+		/// @brief 表示中の行を作り直す
+		/// @remark 元のデータが変わったときに使う
+		void refresh();
+
+		void forEachChild(const std::function<void(UIElement*)>& func)override;
 
 	protected:
-		void onDraw(const RectF&)const override;
 
-		SizeF onGetSize()const override;
+		void onReconcile(UIElement& source)override;
 
-	private:
-		SizeF m_size;
-	};
+		void onUpdate()override;
 
-	/// @brief 文字を表示するUI
-	class TextUI :public UIElement
-	{
-	public:
+		void onDraw(const RectF& drawingArea)const override;
 
-		/// @brief 文字のスタイル
-		TextStyle textStyle;
+		bool isPaintActive()const override;
 
-		/// @brief 文字の色
-		ColorF color;
+		void onBuild()override;
 
-		/// @brief デフォルトのフォントアセット名
-		static AssetName DefaultFontName;
+		void onMoveBy(const Vec2& pos)override;
 
-		/// @brief デフォルトの文字の色
-		static ColorF DefaultColor;
+		SizeF onGetSize()const override;
 
-		struct Parameter
+		bool needsUpdate()const override;
+
+		bool isHitTestIndexBoundary()const noexcept override;
+
+	private:
+
+		struct Item
 		{
-			StringView text;/// @brief 表示する文字列
-			Font font = DefaultFontName ? FontAsset{ TextUI::DefaultFontName } : SimpleGUI::GetFont();/// @brief フォント
-			TextStyle textStyle;/// @brief 文字のスタイル
-			double fontSize = (double)font.fontSize();/// @brief 文字の大きさ
-			ColorF color = TextUI::DefaultColor;/// @brief 文字の色
-			Margin margine;/// @brief 周りのUIとの間隔
-			Optional<double> width;/// @brief 横幅(設定しないと自動計算)
-			Optional<double> height;/// @brief 縦幅(設定しないと自動計算)
-			double flex = 0;/// @brief RowやColumn内での比率
-			bool clickable = false;/// @brief クリック可能か
-			Optional<Relative> relative = none;/// @brief 相対座標(右寄せ、中央寄せなどを指定)
+			size_t index;
+			std::shared_ptr<UIElement> ui;
 		};
 
-		TextUI(const Parameter& para);
+		Builder m_builder;
+		Updater m_updater;
+		Optional<double> m_itemHeight;
+		double m_estimatedItemHeight;
+		size_t m_overscan;
+		Axis m_crossAxis;
 
-		[[nodiscard]]
-		static std::shared_ptr<TextUI>Create(const Parameter& para);
+		size_t m_itemCount = 0;
 
-		[[nodiscard]]
-		String getText()const noexcept;
+		/// @brief 表示中の行(indexの昇順)
+		Array<Item> m_items;
 
-		void setText(StringView text);
+		/// @brief 再利用を待っている行
+		Array<std::shared_ptr<UIElement>> m_pool;
 
-		[[nodiscard]]
-		Font getFont()const noexcept;
+		/// @brief 横幅を計算するための行
+		std::shared_ptr<UIElement> m_prototype;
 
-		void setFont(const Font& font);
+		/// @brief 行ごとの高さ(itemHeightが無いときに使う)
+		Array<double> m_extents;
 
-		[[nodiscard]]
-		double getFontSize()const noexcept;
+		/// @brief 高さの累積和を求めるためのFenwick木
+		Array<double> m_extentTree;
 
-		void setFontSize(double fontSize)noexcept;
+		double m_totalExtent = 0;
 
-	protected:
+		/// @brief 配置の途中で、見積もりと違う行の高さを測った(onUpdateでまとめて通知する)
+		bool m_extentChanged = false;
 
-		void onDraw(const RectF&)const override;
+		/// @brief 最後に行を用意したときの自分の領域
+		RectF m_arrangedRect{};
 
-		SizeF onGetSize()const override;
+		/// @brief 最後に行を用意したときの見えている範囲
+		RectF m_arrangedVisibleArea{};
 
-		double onGetY(double x)const override;
+		/// @brief 領域や見えている範囲が同じでも、行を用意し直すか
+		bool m_itemsDirty = true;
 
-	private:
-		String m_text;
-		Font m_font;
-		double m_fontSize;
+		/// @brief 見えている範囲の行を用意して配置する
+		/// @remark 領域、見えている範囲、行が変わっていなければ何もしない
+		void updateVisibleItems();
+
+		/// @brief 配置の途中で測った行の高さで、スクロールバーに測り直してもらう
+		void notifyExtentChanged();
+
+		[[nodiscard]]
+		RectF getVisibleArea();
+
+		[[nodiscard]]
+		std::shared_ptr<UIElement> acquireItem(size_t index);
+
+		void releaseItem(const std::shared_ptr<UIElement>& ui);
+
+		void releaseAllItems();
+
+		void resetExtents();
+
+		void setExtent(size_t index, double extent);
+
+		[[nodiscard]]
+		double getExtent(size_t index)const noexcept;
+
+		[[nodiscard]]
+		double getOffset(size_t index)const noexcept;
+
+		[[nodiscard]]
+		size_t findIndex(double offset)const noexcept;
+
+		[[nodiscard]]
+		double getTotalExtent()const noexcept;
+	};
+
+	/// @brief 子供をRenderTextureに描いておき、見た目が変わるまでそれを表示するUI
+	/// @remark 変化の少ない複雑なパネルを囲むと、描画が1枚のテクスチャになる
+	/// @remark テクスチャはマルチサンプルで、乗算済みアルファで描いて重ねるので、直接描いたときと同じ見た目になる
+	class RepaintBoundary :public ChildContainer
+	{
+	public:
+
+		/// @brief キャッシュしているテクスチャの統計
+		struct CacheStats
+		{
+			/// @brief テクスチャの数
+			size_t layers = 0;
+
+			/// @brief テクスチャの合計の大きさ(バイト)
+			size_t bytes = 0;
+
+			/// @brief テクスチャに描き直した回数
+			size_t renders = 0;
+		};
+
+		struct Parameter
+		{
+			Margin margine;/// @brief 周りのUIとの間隔
+			Optional<double> width;/// @brief 横幅(設定しないと自動計算)
+			Optional<double> height;/// @brief 縦幅(設定しないと自動計算)
+			double flex = 0;/// @brief RowやColumn内での比率
+			Optional<Relative>relative;/// @brief 相対座標(右寄せ、中央寄せなどを指定)
+			std::shared_ptr<UIElement>child = NoneUI::Create();/// @brief 子供のUI
+		};
+
+		RepaintBoundary(const Parameter& para);
+
+		~RepaintBoundary();
+
+		[[nodiscard]]
+		static std::shared_ptr<RepaintBoundary>Create(const Parameter& para);
+
+		/// @brief すべてのRepaintBoundaryのテクスチャの統計を取得する
+		[[nodiscard]]
+		static CacheStats GetCacheStats()noexcept;
+
+	protected:
+
+		bool needsUpdate()const override;
+
+		void onUpdate()override;
+
+		void onDraw(const RectF&)const override;
+
+	private:
+
+		mutable MSRenderTexture m_texture;
+
+		mutable Size m_textureSize{ 0,0 };
+
+		mutable bool m_cacheValid = false;
+
+		/// @brief テクスチャを確保し直す(統計も更新する)
+		void resizeTexture(const Size& size)const;
+
+		/// @brief 子供をテクスチャに描き直す
+		void render(const RectF& rect)const;
+	};
+
+	/// @brief 長方形を表示するのUI
+	class RectUI :public  UIElement
+	{
+	public:
+
+		struct Parameter
+		{
+			SizeF size = SizeF{ 50,50 };/// @brief 長方形のサイズ
+			ColorF color = Palette::White;/// @brief 長方形の色
+			Margin margine;/// @brief 周りのUIとの間隔
+			Optional<double> width;/// @brief 横幅(設定しないと自動計算)
+			Optional<double> height;/// @brief 縦幅(設定しないと自動計算)
+			double flex = 0;/// @brief RowやColumn内での比率
+			bool clickable = false;/// @brief クリック可能か
+			Optional<Relative> relative = none;/// @brief 相対座標(右寄せ、中央寄せなどを指定)
+			std::function<void()> onClick;/// @brief クリックされたときに呼ぶ関数
+		};
+
+		RectUI(const Parameter& para);
+
+		[[nodiscard]]
+		static std::shared_ptr<RectUI>Create(const Parameter& para);
+
+		[[nodiscard]]
+		SizeF getSize()const noexcept;
+
+		void setSize(const SizeF& size)noexcept;
+
+		/// @brief 長方形の色を取得する
+		[[nodiscard]]
+		ColorF getColor()const noexcept;
+
+		/// @brief 長方形の色を設定する
+		void setColor(const ColorF& color)noexcept;
+
+	protected:
+		void onReconcile(UIElement& source)override;
+
+		void onDraw(const RectF&)const override;
+
+		bool needsUpdate()const override;
+
+		bool isPaintActive()const override;
+
+		SizeF onGetSize()const override;
+
+	private:
+		SizeF m_size;
+
+		ColorF m_color;
+	};
+
+	/// @brief 文字を表示するUI
+	class TextUI :public UIElement
+	{
+	public:
+
+		/// @brief デフォルトのフォントアセット名
+		static AssetName DefaultFontName;
+
+		/// @brief デフォルトの文字の色
+		static ColorF DefaultColor;
+
+		struct Parameter
+		{
+			StringView text;/// @brief 表示する文字列
+			Font font = DefaultFontName ? FontAsset{ TextUI::DefaultFontName } : SimpleGUI::GetFont();/// @brief フォント
+			TextStyle textStyle;/// @brief 文字のスタイル
+			double fontSize = (double)font.fontSize();/// @brief 文字の大きさ
+			ColorF color = TextUI::DefaultColor;/// @brief 文字の色
+			Margin margine;/// @brief 周りのUIとの間隔
+			Optional<double> width;/// @brief 横幅(設定しないと自動計算)
+			Optional<double> height;/// @brief 縦幅(設定しないと自動計算)
+			double flex = 0;/// @brief RowやColumn内での比率
+			bool clickable = false;/// @brief クリック可能か
+			Optional<Relative> relative = none;/// @brief 相対座標(右寄せ、中央寄せなどを指定)
+			std::function<void()> onClick;/// @brief クリックされたときに呼ぶ関数
+		};
+
+		TextUI(const Parameter& para);
+
+		[[nodiscard]]
+		static std::shared_ptr<TextUI>Create(const Parameter& para);
+
+		[[nodiscard]]
+		String getText()const noexcept;
+
+		void setText(StringView text);
+
+		[[nodiscard]]
+		Font getFont()const noexcept;
+
+		void setFont(const Font& font);
+
+		[[nodiscard]]
+		double getFontSize()const noexcept;
+
+		void setFontSize(double fontSize);
+
+		/// @brief 文字のスタイルを取得する
+		[[nodiscard]]
+		TextStyle getTextStyle()const noexcept;
+
+		/// @brief 文字のスタイルを設定する
+		void setTextStyle(const TextStyle& textStyle)noexcept;
+
+		/// @brief 文字の色を取得する
+		[[nodiscard]]
+		ColorF getColor()const noexcept;
+
+		/// @brief 文字の色を設定する
+		void setColor(const ColorF& color)noexcept;
+
+	protected:
+
+		void onReconcile(UIElement& source)override;
+
+		void onDraw(const RectF&)const override;
+
+		bool needsUpdate()const override;
+
+		bool isPaintActive()const override;
+
+		SizeF onGetSize()const override;
+
+		double onGetY(double x)const override;
+
+	private:
+		String m_text;
+		Font m_font;
+		double m_fontSize;
+		TextStyle m_textStyle;
+		ColorF m_color;
+
+		/// @brief 整形済みの文字列(描画に使う)
+		DrawableText m_drawableText;
+
+		struct ShapedGlyph
+		{
+			double xAdvance;
+			size_t pos;/// @brief 元の文字列での位置(合字や結合文字では同じ位置のグリフが続く)
+			bool newLine;
+		};
+
+		/// @brief グリフごとの送り幅
+		Array<ShapedGlyph> m_glyphs;
+
+		/// @brief 折り返さないときの大きさ
+		SizeF m_regionSize{};
+
+		/// @brief 横幅ごとの折り返しの結果
+		struct WrappedLines
+		{
+			double width = 0;
+			Array<size_t> breaks;/// @brief 行の先頭になる文字の、元の文字列での位置
+			double height = 0;
+			mutable Array<DrawableText> lineTexts;/// @brief 行ごとの整形済みの文字列(最初に描くときに作る)
+		};
+
+		static constexpr size_t WrappedLinesCacheCapacity = 4;
+
+		/// @brief 折り返しの判定のゆとり(測った幅でそのまま描いたときに、誤差で最後の文字が折り返されないようにする)
+		static constexpr double WrapEpsilon = 0.1;
+
+		mutable Array<WrappedLines> m_wrappedLinesCache;
+
+		/// @brief 文字列やフォントが変わったときに整形し直す
+		void shape();
+
+		/// @brief 文字の大きさが変わったときに大きさを計算し直す
+		void updateRegion();
+
+		[[nodiscard]]
+		const WrappedLines& getWrappedLines(double width)const;
+
+		/// @brief 折り返した行ごとの整形済みの文字列を取得する
+		[[nodiscard]]
+		const Array<DrawableText>& getLineTexts(const WrappedLines& lines)const;
 	};
 
 	/// @brief 画像を表示するUI
@@ -958,9 +2222,6 @@ namespace BunchoUI
 	{
 	public:
 
-		/// @brief 画像の色
-		ColorF color;
-
 		struct Parameter
 		{
 			TextureRegion texture;/// @brief 表示する画像
@@ -971,6 +2232,7 @@ namespace BunchoUI
 			double flex = 0;/// @brief RowやColumn内での比率
 			bool clickable = false;/// @brief クリック可能か
 			Optional<Relative>relative = none;/// @brief 相対座標(右寄せ、中央寄せなどを指定)
+			std::function<void()> onClick;/// @brief クリックされたときに呼ぶ関数
 		};
 
 		TextureUI(const Parameter& para);
@@ -983,18 +2245,304 @@ namespace BunchoUI
 
 		void setTexture(const TextureRegion& texture);
 
+		/// @brief 画像の色を取得する
+		[[nodiscard]]
+		ColorF getColor()const noexcept;
+
+		/// @brief 画像の色を設定する
+		void setColor(const ColorF& color)noexcept;
+
 	protected:
 
+		void onReconcile(UIElement& source)override;
+
 		bool onMouseOver()const;
 
 		void onDraw(const RectF&)const override;
 
+		bool needsUpdate()const override;
+
+		bool isPaintActive()const override;
+
 		SizeF onGetSize()const override;
 
 	private:
 		TextureRegion m_texture;
+		ColorF m_color;
+	};
+
+	/// @brief 1フレームの統計
+	/// @remark BunchoUI.cppをBUNCHOUI_ENABLE_STATSを定義してビルドしていないときは常に0
+	struct FrameStats
+	{
+		/// @brief 更新したUIの数
+		size_t updateVisits = 0;
+
+		/// @brief 更新を飛ばした部分木の数
+		size_t updateSkips = 0;
+
+		/// @brief onBuildを呼んだ回数
+		size_t buildCalls = 0;
+
+		/// @brief moveByを呼んだ回数
+		size_t moveByCalls = 0;
+
+		/// @brief 部分木だけを再配置した回数
+		size_t localRelayouts = 0;
+
+		/// @brief 描画したUIの数
+		size_t drawVisits = 0;
+
+		/// @brief Painterで描いた(記録した)図形・文字・テクスチャの数
+		size_t drawCommands = 0;
+
+		/// @brief 前のフレームの記録を再生した部分木の数
+		size_t drawReplays = 0;
+
+		/// @brief 切り抜きの範囲を変えた回数
+		size_t clipChanges = 0;
+
+		/// @brief 描き直した範囲の数(UIManager::setDamageRedrawが有効なとき)
+		size_t damageRects = 0;
+
+		/// @brief getSize・getX・getYがキャッシュから返した回数
+		size_t measureHits = 0;
+
+		/// @brief getSize・getX・getYが計算し直した回数
+		size_t measureMisses = 0;
+
+		/// @brief 更新にかかった時間(ミリ秒)
+		double updateTime = 0;
+
+		/// @brief レイアウトにかかった時間(ミリ秒)
+		double layoutTime = 0;
+
+		/// @brief 描画にかかった時間(ミリ秒)
+		double drawTime = 0;
+	};
+
+	/// @brief 各段階にかかった時間(ミリ秒)
+	struct PhaseTimes
+	{
+		double update = 0;
+
+		double layout = 0;
+
+		double draw = 0;
 	};
 
+	namespace detail
+	{
+		/// @brief 集計中のフレームの統計
+		[[nodiscard]]
+		FrameStats& CurrentFrameStats();
+	}
+
+	/// @brief UIの木を前順に並べ、要素ごとに連続した配列で持つクラス
+	/// @remark 当たり判定など木全体をたどる処理を、ポインタをたどる再帰なしで行うために使う
+	/// @remark 子供を当たり判定の格子に登録しないUI(isHitTestIndexBoundary)の子孫は並べない
+	/// @remark 当たり判定のための索引で、更新と描画は今まで通り木を再帰でたどる
+	/// @remark 並べたUIが破棄されると、その位置はnullptrになる(次に並べ直すまで)
+	class FlatTree
+	{
+	public:
+
+		FlatTree() = default;
+
+		~FlatTree();
+
+		FlatTree(const FlatTree&) = delete;
+
+		FlatTree& operator=(const FlatTree&) = delete;
+
+		/// @brief 種類を表すフラグ
+		enum Flag : uint8
+		{
+			Clickable = 1 << 0,
+			IndexBoundary = 1 << 1,
+		};
+
+		/// @brief 親が無いことを表す番号
+		static constexpr uint32 NoParent = UINT32_MAX;
+
+		/// @brief 木から並べ直す
+		/// @param root 木の根
+		void rebuild(UIElement& root);
+
+		/// @brief 部分木だけを並べ直す
+		/// @param subtree 部分木の根
+		/// @return 並べ直せたか(部分木が並んでいないときはfalse)
+		bool update(UIElement& subtree);
+
+		void clear()noexcept;
+
+		[[nodiscard]]
+		size_t size()const noexcept;
+
+		/// @brief UIが並んでいる位置を探す
+		/// @param element 探すUI
+		/// @return 位置(並んでいないときはnone)
+		[[nodiscard]]
+		Optional<size_t> indexOf(const UIElement& element)const noexcept;
+
+		/// @brief 並んでいるUIを取得する
+		/// @return UI(破棄されたときはnullptr)
+		[[nodiscard]]
+		UIElement* getNode(size_t index)const noexcept;
+
+		/// @brief 当たり判定の範囲
+		[[nodiscard]]
+		const Array<RectF>& getHitTestRects()const noexcept;
+
+		/// @brief 親の位置(根はNoParent)
+		[[nodiscard]]
+		const Array<uint32>& getParents()const noexcept;
+
+		/// @brief 部分木の終わりの位置(この位置の手前までが部分木)
+		[[nodiscard]]
+		const Array<uint32>& getSubtreeEnds()const noexcept;
+
+		[[nodiscard]]
+		const Array<uint8>& getFlags()const noexcept;
+
+		/// @brief 指定した座標に当たり判定がある、一番手前のUIを探す
+		/// @param pos 座標
+		/// @return 一番手前のUI(無いときはnullptr)
+		/// @remark 当たり判定の範囲(長方形)だけで調べる
+		[[nodiscard]]
+		UIElement* hitTest(const Vec2& pos)const noexcept;
+
+	private:
+
+		friend class UIElement;
+
+		Array<UIElement*> m_nodes;
+
+		Array<RectF> m_hitTestRects;
+
+		Array<uint32> m_parents;
+
+		Array<uint32> m_subtreeEnds;
+
+		Array<uint8> m_flags;
+
+		void append(UIElement* element, uint32 parent, uint32 offset);
+
+		/// @brief 並んでいる範囲のUIを、この木に並んでいることにする
+		void attach(size_t begin, size_t end)noexcept;
+
+		/// @brief 並んでいる範囲のUIとの結びつきを外す
+		/// @remark 他のFlatTreeに並べ直されたUIはそのままにする
+		void detach(size_t begin, size_t end)noexcept;
+
+		/// @brief 破棄されるUIの位置を空ける
+		void release(const UIElement& element)noexcept;
+	};
+
+	/// @brief カーソルに触れている可能性があるUIを素早く探すための格子
+	/// @remark 印がついていないUIはonMouseOverを呼ばずに触れていないとみなす
+	class HitTestGrid
+	{
+	public:
+
+		/// @brief 並べたUIの木から格子を作り直す
+		/// @param tree 登録する木
+		/// @param area 格子で覆う範囲
+		void rebuild(const FlatTree& tree, const RectF& area);
+
+		/// @brief 再配置した部分木だけを登録し直す
+		/// @param tree 部分木を並べ直した後の木
+		/// @param subtree 再配置した部分木の根
+		void update(const FlatTree& tree, const UIElement& subtree);
+
+		/// @brief 格子を使わないようにする
+		void invalidate()noexcept;
+
+		/// @brief 指定した座標が当たり判定の範囲に入るUIに、このフレームの印をつける
+		/// @param pos 調べる座標(カーソルの座標)
+		/// @remark 升目の範囲はSSE2が使えるときは4つずつまとめて調べる
+		void mark(const Vec2& pos);
+
+	private:
+
+		static constexpr double CellSize = 64;
+
+		uint64 m_id = 0;
+
+		bool m_valid = false;
+
+		const FlatTree* m_tree = nullptr;
+
+		/// @brief 登録した数
+		size_t m_entryCount = 0;
+
+		/// @brief 登録し直して古くなった数(多くなったら作り直す)
+		size_t m_staleEntryCount = 0;
+
+		/// @brief 作り直したときの、登録済みのUIが破棄された回数
+		uint64 m_destroyedCount = 0;
+
+		RectF m_area{};
+
+		size_t m_columns = 0;
+
+		size_t m_rows = 0;
+
+		/// @brief 升目に登録したUIと、その範囲をまとめて調べられるように並べたもの
+		/// @remark 範囲はfloatで外側に丸めて持つので、通ったUIはonMouseOverで正確に調べる
+		struct Cell
+		{
+			Array<UIElement*> elements;
+
+			Array<float> lefts;
+
+			Array<float> tops;
+
+			Array<float> rights;
+
+			Array<float> bottoms;
+
+			void clear()noexcept;
+
+			void add(UIElement* element, const RectF& rect);
+		};
+
+		Array<Cell>m_cells;
+
+		void insert(UIElement* element, const RectF& rect);
+
+		void insertRange(const FlatTree& tree, size_t begin, size_t end);
+
+		[[nodiscard]]
+		size_t getColumn(double x)const noexcept;
+
+		[[nodiscard]]
+		size_t getRow(double y)const noexcept;
+	};
+
+	/// @brief 1フレーム分のマウスの入力
+	/// @remark 自動テストなどで、実際のマウスの代わりにUIManager::updateに渡す
+	struct MouseInput
+	{
+		Vec2 pos{ 0,0 };/// @brief カーソルの座標
+		bool leftDown = false;/// @brief 左ボタンが押されたか
+		bool leftUp = false;/// @brief 左ボタンが離されたか
+		double wheel = 0;/// @brief ホイールの回転量
+		bool leftPressed = false;/// @brief 左ボタンが押されているか
+
+		/// @brief このフレームの実際の入力を取得する
+		[[nodiscard]]
+		static MouseInput Current();
+	};
+
+	namespace detail
+	{
+		/// @brief UIが読むマウスの入力
+		/// @return 更新中のUIManagerに渡された入力(更新中でなければ、このフレームの実際の入力)
+		[[nodiscard]]
+		MouseInput CurrentMouseInput();
+	}
+
 	/// @brief UIを管理するクラス
 	class UIManager
 	{
@@ -1004,13 +2552,59 @@ namespace BunchoUI
 		/// @param rect UIを配置する領域
 		explicit UIManager(const RectF& rect = Scene::Rect());
 
+		~UIManager();
+
+		UIManager(const UIManager&) = delete;
+
+		UIManager& operator=(const UIManager&) = delete;
+
 		/// @brief 更新する
 		/// @param rect UIを配置する領域
+		/// @remark 最初にlayoutを行うので、直前に追加・変更したUIもこのフレームからクリックできる
 		void update(const RectF& rect = Scene::Rect());
 
+		/// @brief 実際のマウスの代わりに、渡した入力で更新する
+		/// @param rect UIを配置する領域
+		/// @param input このフレームのマウスの入力
+		/// @remark 入力はカーソルとの判定とイベントのほか、UIが直接読むボタンの状態(clicked、スライダーのつまみ、スクロールバーのドラッグとホイールなど)にも使われる
+		/// @remark drawの中で読むpressedは実際の入力のまま
+		void update(const RectF& rect, const MouseInput& input);
+
+		/// @brief 変更されたUIを並べ直し、当たり判定を登録し直す
+		/// @remark updateとdrawの最初に呼ばれる。変更した直後にUIの位置やhitTestを使いたいときに呼ぶ
+		/// @remark 変更が無ければ何もしない
+		void layout()const;
+
 		/// @brief レイアウトの更新と描画を行う
 		void draw()const;
 
+		/// @brief 描画する代わりに、描画命令を記録する
+		/// @param drawList 記録するリスト
+		void draw(DrawList& drawList)const;
+
+		/// @brief 前のフレームの描画を覚えておき、変わっていない部分木は記録を再生するかを設定する
+		/// @param enabled 再生するか
+		/// @remark 有効にする場合、自作のUIで描画に使うメンバを書き換えたときはUIElement::invalidateを呼ぶ
+		/// @remark Painterを使わずに描画するUIがあると、描画の順番が変わるので使えない
+		void setDrawReplay(bool enabled)noexcept;
+
+		[[nodiscard]]
+		bool isDrawReplay()const noexcept;
+
+		/// @brief 描いた絵をテクスチャに残しておき、見た目が変わった範囲だけを描き直すかを設定する
+		/// @param enabled 変わった範囲だけを描き直すか
+		/// @remark 有効にする場合、自作のUIで描画に使うメンバを書き換えたときはUIElement::invalidateを呼ぶ
+		/// @remark 記録の再生(setDrawReplay)より優先される
+		void setDamageRedraw(bool enabled)noexcept;
+
+		[[nodiscard]]
+		bool isDamageRedraw()const noexcept;
+
+		/// @brief 直前のフレームで描き直した範囲を取得する
+		/// @return 描き直した範囲(setDamageRedrawが有効なときだけ)
+		[[nodiscard]]
+		const Array<RectF>& getDamageRects()const noexcept;
+
 		void setChildren(const Array<std::shared_ptr<UIElement>>& children);
 
 		void addChild(const std::shared_ptr<UIElement>& child);
@@ -1020,9 +2614,119 @@ namespace BunchoUI
 		[[nodiscard]]
 		const Array<std::shared_ptr<UIElement>>& getChildren()const noexcept;
 
+		/// @brief 前回のレイアウトでUIの木を並べたものを取得する
+		/// @return 並べた木
+		[[nodiscard]]
+		const FlatTree& getFlatTree()const noexcept;
+
+		/// @brief 指定した座標に当たり判定がある、一番手前のUIを探す
+		/// @param pos 座標
+		/// @return 一番手前のUI(無いときはnullptr)
+		[[nodiscard]]
+		UIElement* hitTest(const Vec2& pos)const noexcept;
+
+		/// @brief スコープの間、UIの変更による親への通知をまとめる
+		/// @remark たくさんのUIを一度に変更するときに使う
+		class Transaction
+		{
+		public:
+
+			Transaction()noexcept;
+
+			~Transaction();
+
+			Transaction(const Transaction&) = delete;
+
+			Transaction& operator=(const Transaction&) = delete;
+		};
+
+		/// @brief UIの変更による親への通知をまとめるスコープを作る
+		/// @return スコープ(破棄されたときに通知する)
+		[[nodiscard]]
+		Transaction transaction()const noexcept;
+
+		/// @brief 直前のフレーム(update～draw)の統計を取得する
+		/// @return 統計
+		/// @remark BunchoUI.cppをBUNCHOUI_ENABLE_STATSを定義してビルドしていないときは常に0
+		[[nodiscard]]
+		const FrameStats& getFrameStats()const noexcept;
+
+		/// @brief 最近のフレームの、各段階にかかった時間の百分位数を取得する
+		/// @param percentile 百分位(0～100 例:50で中央値、99で99パーセンタイル)
+		/// @return 各段階にかかった時間
+		[[nodiscard]]
+		PhaseTimes getPhaseTimePercentile(double percentile)const;
+
 	private:
 		RectF m_rect{};
 		std::shared_ptr<StackUI>m_stackUI = StackUI::Create({});
+		mutable FlatTree m_flatTree;
+		mutable HitTestGrid m_hitTestGrid;
+
+		bool m_drawReplay = false;
+
+		/// @brief 最後に記録した描画と、その1つ前の描画
+		mutable DrawList m_drawList;
+		mutable DrawList m_previousDrawList;
+
+		/// @brief 描画を記録した回数
+		mutable uint64 m_drawFrame = 0;
+
+		/// @brief 前のフレームの記録を使いながら、描画を記録し直す
+		void recordDraw()const;
+
+		bool m_damageRedraw = false;
+
+		/// @brief 描き直す範囲の数の上限(超えたら全体を囲む1つにまとめる)
+		static constexpr size_t MaxDamageRects = 8;
+
+		/// @brief 前のフレームまでの絵
+		mutable MSRenderTexture m_backbuffer;
+
+		/// @brief m_backbufferに描いたときの領域
+		mutable RectF m_backbufferRect{};
+
+		mutable Array<RectF> m_damageRects;
+
+		/// @brief 見た目が変わった範囲だけをm_backbufferに描き直して、画面に描く
+		void drawDamage()const;
+
+		/// @brief 百分位数の計算に使うフレームの数
+		static constexpr size_t StatsHistorySize = 120;
+
+		mutable FrameStats m_frameStats;
+		mutable Array<FrameStats> m_statsHistory;
+		mutable size_t m_statsHistoryIndex = 0;
+
+		/// @brief 集計中のフレームの統計を締めて、次のフレームを始める
+		void beginFrameStats()const;
+
+		friend class UIElement;
+
+		/// @brief 更新中に見つかった、カーソルが触れている一番手前で深いUI
+		UIElement* m_hoverTarget = nullptr;
+
+		/// @brief 左ボタンが押されたときのUI(離されたときにクリックを判定する)
+		UIElement* m_pressTarget = nullptr;
+
+		/// @brief 前の更新で渡されたカーソルの座標(ドラッグの移動量を求める)
+		Optional<Vec2> m_previousInputPos;
+
+		struct PendingEvent
+		{
+			UIEventType type;
+
+			UIElement* target;
+		};
+
+		/// @brief 更新が終わってから送る、マウスが触れた・離れたイベント
+		Array<PendingEvent> m_pendingEvents;
+
+		/// @brief 更新で見つかったカーソルの下のUIへ、このフレームの入力のイベントを送る
+		void dispatchEvents(const MouseInput& input);
+
+		/// @brief 破棄されるUIを、イベントを送る対象から外す
+		void releaseElement(const UIElement* element)noexcept;
 	};
 }
 
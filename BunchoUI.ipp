@@ -2,6 +2,41 @@
 
 namespace BunchoUI
 {
+	//-----------------------------------------------
+	//  NodeAllocator
+	//-----------------------------------------------
+
+	template<typename Type>
+	template<typename Other>
+	NodeAllocator<Type>::NodeAllocator(const NodeAllocator<Other>& other)noexcept
+		:pooled{ other.pooled } {
+	}
+
+	template<typename Type>
+	Type* NodeAllocator<Type>::allocate(size_t n)
+	{
+		return static_cast<Type*>(NodePool::Allocate(sizeof(Type) * n, pooled && alignof(Type) <= alignof(std::max_align_t)));
+	}
+
+	template<typename Type>
+	void NodeAllocator<Type>::deallocate(Type* p, size_t n)noexcept
+	{
+		NodePool::Deallocate(p, sizeof(Type) * n, pooled && alignof(Type) <= alignof(std::max_align_t));
+	}
+
+	template<typename Type>
+	template<typename Other>
+	bool NodeAllocator<Type>::operator==(const NodeAllocator<Other>& other)const noexcept
+	{
+		return pooled == other.pooled;
+	}
+
+	template<typename Type, typename... Args>
+	std::shared_ptr<Type>MakeNode(Args&&... args)
+	{
+		return std::allocate_shared<Type>(NodeAllocator<Type>{}, std::forward<Args>(args)...);
+	}
+
 	//-----------------------------------------------
 	//  Margin
 	//-----------------------------------------------
@@ -121,29 +156,231 @@ namespace BunchoUI
 		return { 0.0,0.5 };
 	}
 
+	//-----------------------------------------------
+	//  BoxConstraints
+	//-----------------------------------------------
+
+	constexpr BoxConstraints BoxConstraints::Unbounded()noexcept
+	{
+		return {};
+	}
+
+	constexpr BoxConstraints BoxConstraints::Tight(const SizeF& size)noexcept
+	{
+		return { size,size };
+	}
+
+	constexpr BoxConstraints BoxConstraints::TightWidth(double width)noexcept
+	{
+		return { SizeF{ width,0 },SizeF{ width,Math::Inf } };
+	}
+
+	constexpr BoxConstraints BoxConstraints::TightHeight(double height)noexcept
+	{
+		return { SizeF{ 0,height },SizeF{ Math::Inf,height } };
+	}
+
+	constexpr BoxConstraints BoxConstraints::Loose(const SizeF& size)noexcept
+	{
+		return { SizeF{ 0,0 },size };
+	}
+
+	constexpr bool BoxConstraints::hasTightWidth()const noexcept
+	{
+		return min.x == max.x;
+	}
+
+	constexpr bool BoxConstraints::hasTightHeight()const noexcept
+	{
+		return min.y == max.y;
+	}
+
+	inline BoxConstraints BoxConstraints::deflate(const SizeF& size)const noexcept
+	{
+		BoxConstraints result{ min - size,max - size };
+
+		//決まっている長さはそのまま引き、それ以外は0未満にしない
+		if (not hasTightWidth())
+		{
+			result.min.x = Max(result.min.x, 0.0);
+		}
+
+		if (not hasTightHeight())
+		{
+			result.min.y = Max(result.min.y, 0.0);
+		}
+
+		return result;
+	}
+
+	inline SizeF BoxConstraints::constrain(const SizeF& size)const noexcept
+	{
+		return { Clamp(size.x,min.x,max.x),Clamp(size.y,min.y,max.y) };
+	}
+
+	//-----------------------------------------------
+	//  Invalidation
+	//-----------------------------------------------
+
+	constexpr Invalidation operator|(Invalidation a, Invalidation b)noexcept
+	{
+		return static_cast<Invalidation>(static_cast<uint8>(a) | static_cast<uint8>(b));
+	}
+
+	constexpr Invalidation operator&(Invalidation a, Invalidation b)noexcept
+	{
+		return static_cast<Invalidation>(static_cast<uint8>(a) & static_cast<uint8>(b));
+	}
+
+	constexpr Invalidation& operator|=(Invalidation& a, Invalidation b)noexcept
+	{
+		return a = a | b;
+	}
+
+	//-----------------------------------------------
+	//  UIEvent
+	//-----------------------------------------------
+
+	inline void UIEvent::stopPropagation()noexcept
+	{
+		stopped = true;
+	}
+
 	//-----------------------------------------------
 	//  UIElement
 	//-----------------------------------------------
 
 	inline UIElement::UIElement(const Margin& margine, const Optional<double>& width, const Optional<double>& height, double flex, bool clickable, const Optional<Relative>& relative)
 		:m_margine{ margine }
-		, clickable{ clickable }
 		, m_relative{ relative }
 		, m_flex{ flex }
 		, m_width{ width }
-		, m_height{ height } {
+		, m_height{ height }
+		, m_clickable{ clickable } {
 	}
 
 	inline void UIElement::changeSize()noexcept
 	{
+		m_updateBoundsValid = false;
+
+		if (m_relayoutFlg)
+		{
+			return;
+		}
+
 		if (not m_changeSizeFlg)
 		{
 			m_changeSizeFlg = true;
-			m_preSize = none;
-			m_preX = none;
-			m_preY = none;
+			m_measureCache.clear();
+
+			//大きさが変わらないなら、親には伝えずに自身の部分木だけ再配置する
+			if (isRelayoutBoundary())
+			{
+				m_relayoutFlg = true;
+
+				for (UIElement* parent = getParent(); parent && not parent->m_descendantRelayoutFlg; parent = parent->getParent())
+				{
+					parent->m_descendantRelayoutFlg = true;
+					parent->m_updateBoundsValid = false;
+				}
+				return;
+			}
+		}
+
+		if (IsInTransaction())
+		{
+			deferNotifyParent();
+			return;
+		}
+
+		notifyParent();
+	}
+
+	inline void UIElement::changePaint()noexcept
+	{
+		m_damaged = true;
+
+		for (UIElement* element = this; element && not element->m_paintDirty; element = element->getParent())
+		{
+			element->m_paintDirty = true;
+		}
+	}
+
+	inline std::pair<size_t, size_t> UIElement::getAwakeChildRange()const noexcept
+	{
+		return { m_awakeChildBegin,m_awakeChildEnd };
+	}
+
+	inline void UIElement::changeHitTest()noexcept
+	{
+		m_hitTestDirty = true;
+		m_updateBoundsValid = false;
+
+		for (UIElement* element = getParent(); element; element = element->getParent())
+		{
+			element->m_updateBoundsValid = false;
+			element->m_descendantHitTestDirty = true;
+		}
+	}
+
+	inline void UIElement::invalidate(Invalidation invalidation)noexcept
+	{
+		if ((invalidation & Invalidation::Layout) != Invalidation::None)
+		{
+			changeSize();
+		}
+
+		if ((invalidation & (Invalidation::Position | Invalidation::Paint)) != Invalidation::None)
+		{
+			changePaint();
+		}
+
+		if ((invalidation & (Invalidation::Position | Invalidation::HitTest)) != Invalidation::None)
+		{
+			changeHitTest();
+		}
+	}
+
+	inline Invalidation UIElement::getInvalidation()const noexcept
+	{
+		Invalidation result = Invalidation::None;
+
+		if (m_changeSizeFlg || m_relayoutFlg || m_descendantRelayoutFlg)
+		{
+			result |= Invalidation::Layout;
+		}
+
+		if (m_paintDirty)
+		{
+			result |= Invalidation::Paint;
+		}
+
+		if (m_hitTestDirty || m_descendantHitTestDirty)
+		{
+			result |= Invalidation::HitTest;
 		}
 
+		return result;
+	}
+
+	inline bool UIElement::isClickable()const noexcept
+	{
+		return m_clickable;
+	}
+
+	inline void UIElement::setClickable(bool clickable)noexcept
+	{
+		if (m_clickable == clickable)
+		{
+			return;
+		}
+
+		m_clickable = clickable;
+		invalidate(Invalidation::Paint | Invalidation::HitTest);
+	}
+
+	inline void UIElement::notifyParent()noexcept
+	{
 		UIElement* parent = getParent();
 		if (parent && not parent->m_changeSizeFlg)
 		{
@@ -151,24 +388,55 @@ namespace BunchoUI
 		}
 	}
 
-	inline bool UIElement::isChangeSize()const noexcept
+	inline void UIElement::changeLayout()noexcept
 	{
-		return m_changeSizeFlg;
+		changeSize();
+
+		if (UIElement* parent = getParent())
+		{
+			parent->changeSize();
+		}
+	}
+
+	inline Optional<SizeF> UIElement::MeasureCache::find(const BoxConstraints& key)const noexcept
+	{
+		for (size_t i = 0; i < size; ++i)
+		{
+			if (constraints[i] == key)
+			{
+				return results[i];
+			}
+		}
+		return none;
+	}
+
+	inline void UIElement::MeasureCache::add(const BoxConstraints& key, const SizeF& result)noexcept
+	{
+		constraints[next] = key;
+		results[next] = result;
+		next = (next + 1) % Capacity;
+		size = Min(size + 1, Capacity);
 	}
 
-	inline void UIElement::draw(const RectF& rect)const
+	inline void UIElement::MeasureCache::clear()noexcept
 	{
-		onDraw(rect);
+		size = 0;
+		next = 0;
+	}
+
+	inline bool UIElement::isChangeSize()const noexcept
+	{
+		return m_changeSizeFlg;
 	}
 
 	inline bool UIElement::clicked()const noexcept
 	{
-		return m_mouseOvered && clickable && MouseL.down();
+		return m_mouseOvered && m_clickable && detail::CurrentMouseInput().leftDown;
 	}
 
 	inline bool UIElement::pressed()const noexcept
 	{
-		return m_mouseOvered && clickable && MouseL.pressed();
+		return m_mouseOvered && m_clickable && detail::CurrentMouseInput().leftPressed;
 	}
 
 	inline bool UIElement::mouseOver()const noexcept
@@ -176,6 +444,24 @@ namespace BunchoUI
 		return m_mouseOvered;
 	}
 
+	inline void UIElement::addEventListener(const UIEventType type, const UIEventHandler& handler, const bool capture)
+	{
+		m_eventListeners << EventListener{ type, capture, handler };
+	}
+
+	inline void UIElement::addClickListener(const std::function<void()>& onClick)
+	{
+		if (onClick)
+		{
+			addEventListener(UIEventType::Click, [onClick](UIEvent&) { onClick(); });
+		}
+	}
+
+	inline void UIElement::clearEventListeners()noexcept
+	{
+		m_eventListeners.clear();
+	}
+
 	inline RectF UIElement::getMargineRect()const noexcept
 	{
 		RectF area = m_rect;
@@ -202,8 +488,13 @@ namespace BunchoUI
 
 	inline void UIElement::setMargine(const Margin& margin)noexcept
 	{
+		if (m_margine == margin)
+		{
+			return;
+		}
+
 		m_margine = margin;
-		changeSize();
+		changeLayout();
 	}
 
 	inline Margin UIElement::getMargin()const noexcept
@@ -213,8 +504,13 @@ namespace BunchoUI
 
 	inline void UIElement::setWidth(const Optional<double>& width)noexcept
 	{
+		if (m_width == width)
+		{
+			return;
+		}
+
 		m_width = width;
-		changeSize();
+		changeLayout();
 	}
 
 	inline Optional<double>UIElement::getWidth()const noexcept
@@ -224,8 +520,13 @@ namespace BunchoUI
 
 	inline void UIElement::setHeight(const Optional<double>& height)noexcept
 	{
+		if (m_height == height)
+		{
+			return;
+		}
+
 		m_height = height;
-		changeSize();
+		changeLayout();
 	}
 
 	inline Optional<double>UIElement::getHeight()const noexcept
@@ -235,8 +536,13 @@ namespace BunchoUI
 
 	inline void UIElement::setFlex(double flex) noexcept
 	{
+		if (m_flex == flex)
+		{
+			return;
+		}
+
 		m_flex = flex;
-		changeSize();
+		changeLayout();
 	}
 
 	inline double UIElement::getFlex()const noexcept
@@ -246,8 +552,13 @@ namespace BunchoUI
 
 	inline void UIElement::setRelative(const Optional<Relative>& relative)noexcept
 	{
+		if (m_relative == relative)
+		{
+			return;
+		}
+
 		m_relative = relative;
-		changeSize();
+		changeLayout();
 	}
 
 	inline Optional<Relative>UIElement::getRelative()const noexcept
@@ -255,23 +566,19 @@ namespace BunchoUI
 		return m_relative;
 	}
 
-	inline void UIElement::moveBy(const Vec2& pos)
-	{
-		m_rect.pos += pos;
-		onMoveBy(pos);
-	}
-
 	inline void UIElement::setPos(const Vec2& pos)
 	{
 		Vec2 oldPos = m_rect.pos;
 		oldPos.x -= m_margine.left;
 		oldPos.y -= m_margine.top;
 		moveBy(pos - oldPos);
+		invalidate(Invalidation::Position);
 	}
 
 	inline void UIElement::setCenter(const Vec2& center)
 	{
 		moveBy(center - getMargineRect().center());
+		invalidate(Invalidation::Position);
 	}
 
 	inline UIElement* UIElement::getParent()
@@ -285,10 +592,20 @@ namespace BunchoUI
 		return dynamic_cast<Type*>(getParent());
 	}
 
+	inline void UIElement::setKey(StringView key)
+	{
+		m_key = key;
+	}
+
+	inline const String& UIElement::getKey()const noexcept
+	{
+		return m_key;
+	}
+
 	inline void UIElement::setParent(UIElement* parent)
 	{
 		m_parent = parent;
-		changeSize();
+		changeLayout();
 	}
 
 	inline RectF UIElement::getRect()const noexcept
@@ -307,7 +624,7 @@ namespace BunchoUI
 
 	inline std::shared_ptr<NoneUI>NoneUI::Create()
 	{
-		return std::make_shared<NoneUI>();
+		return MakeNode<NoneUI>();
 	}
 
 	//-----------------------------------------------
@@ -422,7 +739,10 @@ namespace BunchoUI
 
 	inline void ChildContainer::childDraw(const RectF& drawingArea)const
 	{
-		m_child->draw(drawingArea);
+		if (drawingArea.intersects(m_child->getMargineRect()))
+		{
+			m_child->draw(drawingArea);
+		}
 	}
 
 	//-----------------------------------------------
@@ -441,6 +761,11 @@ namespace BunchoUI
 
 	inline void PanelBase::setPadding(const Padding& padding) noexcept
 	{
+		if (m_padding == padding)
+		{
+			return;
+		}
+
 		m_padding = padding;
 		changeSize();
 	}
@@ -459,6 +784,11 @@ namespace BunchoUI
 	template<UIDirection mainDirection, UIDirection crossDirection>
 	void BaseArrange<mainDirection, crossDirection>::setMainAxis(const MainAxis& mainAxis)noexcept
 	{
+		if (m_mainAxis == mainAxis)
+		{
+			return;
+		}
+
 		m_mainAxis = mainAxis;
 		changeSize();
 	}
@@ -472,6 +802,11 @@ namespace BunchoUI
 	template<UIDirection mainDirection, UIDirection crossDirection>
 	void BaseArrange<mainDirection, crossDirection>::setCrossAxis(const CrossAxis& crossAxis)noexcept
 	{
+		if (m_crossAxis == Axis{ crossAxis })
+		{
+			return;
+		}
+
 		m_crossAxis = crossAxis;
 		changeSize();
 	}
@@ -573,23 +908,112 @@ namespace BunchoUI
 	}
 
 	template<UIDirection mainDirection, UIDirection crossDirection>
-	SizeF BaseArrange<mainDirection, crossDirection>::onGetSize()const
+	bool BaseArrange<mainDirection, crossDirection>::needsUpdate()const
 	{
-		double mainSum = 0, crossMax = 0;
-		for (const auto& child : m_children)
+		return hasMouseCapture();
+	}
+
+	template<UIDirection mainDirection, UIDirection crossDirection>
+	void BaseArrange<mainDirection, crossDirection>::onUpdate()
+	{
+		const Optional<RectF>& area = GetUpdateArea();
+
+		if (not area)
+		{
+			ChildrenContainer::onUpdate();
+			return;
+		}
+
+		//見えている子供と、隠れていても更新が必要な子供を更新する
+		auto [begin, end] = getVisibleRange(*area);
+		const auto [awakeBegin, awakeEnd] = getAwakeChildRange();
+		if (awakeBegin < awakeEnd)
+		{
+			begin = Min(begin, awakeBegin);
+			end = Max(end, Min(awakeEnd, m_children.size()));
+		}
+
+		for (size_t i = end; begin < i; --i)
+		{
+			m_children[i - 1]->update();
+		}
+	}
+
+	template<UIDirection mainDirection, UIDirection crossDirection>
+	void BaseArrange<mainDirection, crossDirection>::onDraw(const RectF& drawingArea)const
+	{
+		const auto [begin, end] = getVisibleRange(drawingArea);
+		for (size_t i = begin; i < end; ++i)
 		{
-			SizeF size = child->getSize();
-			mainSum += get<mainDirection>(size);
-			crossMax = Max(get<crossDirection>(size), crossMax);
+			if (drawingArea.intersects(m_children[i]->getMargineRect()))
+			{
+				m_children[i]->draw(drawingArea);
+			}
 		}
+	}
+
+	template<UIDirection mainDirection, UIDirection crossDirection>
+	std::pair<size_t, size_t> BaseArrange<mainDirection, crossDirection>::getVisibleRange(const RectF& area)const
+	{
+		const double areaBegin = get<mainDirection>(area.pos);
+		const double areaEnd = get<mainDirection>(area.br());
+
+		//範囲より手前で終わる子供と、範囲より後ろから始まる子供を除く
+		const auto first = std::partition_point(m_children.begin(), m_children.end(),
+			[&](const std::shared_ptr<UIElement>& child) { return get<mainDirection>(child->getMargineRect().br()) <= areaBegin; });
+		const auto last = std::partition_point(first, m_children.end(),
+			[&](const std::shared_ptr<UIElement>& child) { return get<mainDirection>(child->getMargineRect().pos) < areaEnd; });
+
+		return { static_cast<size_t>(first - m_children.begin()),static_cast<size_t>(last - m_children.begin()) };
+	}
+
+	template<UIDirection mainDirection, UIDirection crossDirection>
+	SizeF BaseArrange<mainDirection, crossDirection>::onMeasure(const BoxConstraints& constraints)const
+	{
+		const bool tightMain = (mainDirection == UIDirection::x) ? constraints.hasTightWidth() : constraints.hasTightHeight();
+		const bool tightCross = (crossDirection == UIDirection::x) ? constraints.hasTightWidth() : constraints.hasTightHeight();
+
+		if (tightMain && tightCross)
+		{
+			return constraints.min;
+		}
+
 		SizeF size{};
-		get<mainDirection>(size) = mainSum;
-		get<crossDirection>(size) = crossMax;
-		return size;
+
+		if (tightCross)
+		{
+			get<crossDirection>(size) = get<crossDirection>(constraints.min);
+			get<mainDirection>(size) = measureMain(get<crossDirection>(size));
+			return size;
+		}
+
+		if (tightMain)
+		{
+			get<mainDirection>(size) = get<mainDirection>(constraints.min);
+			get<crossDirection>(size) = measureCross(get<mainDirection>(size));
+			return size;
+		}
+
+		//制約がなければ、子供のデフォルトの大きさを並べる
+		for (const auto& child : m_children)
+		{
+			const SizeF childSize = child->measure(BoxConstraints::Unbounded());
+			get<mainDirection>(size) += get<mainDirection>(childSize);
+			get<crossDirection>(size) = Max(get<crossDirection>(size), get<crossDirection>(childSize));
+		}
+
+		//横幅が足りなければ、最大の横幅に決めて計算し直す
+		if (constraints.max.x < size.x)
+		{
+			size.x = constraints.max.x;
+			size.y = (mainDirection == UIDirection::x) ? measureCross(size.x) : measureMain(size.x);
+		}
+
+		return constraints.constrain(size);
 	}
 
 	template<UIDirection mainDirection, UIDirection crossDirection>
-	double BaseArrange<mainDirection, crossDirection>::onGetMain(double cross)const
+	double BaseArrange<mainDirection, crossDirection>::measureMain(double cross)const
 	{
 		double sum = 0;
 		for (const auto& child : m_children)
@@ -600,15 +1024,15 @@ namespace BunchoUI
 	}
 
 	template<UIDirection mainDirection, UIDirection crossDirection>
-	double BaseArrange<mainDirection, crossDirection>::onGetCross(double main)const
+	double BaseArrange<mainDirection, crossDirection>::measureCross(double main)const
 	{
-		Array<double>crossList(m_children.size());
-
 		Array<size_t>expandedIndex;
 
 		double fixedSum = 0;
 		double sumRate = 0;
+		double max = 0;
 
+		//flexのない子供は、デフォルトの大きさを一度だけ測る
 		for (size_t i = 0; i < m_children.size(); ++i)
 		{
 			if (m_children[i]->getFlex())
@@ -618,27 +1042,21 @@ namespace BunchoUI
 			}
 			else
 			{
-				SizeF size = m_children[i]->getSize();
+				const SizeF size = m_children[i]->measure(BoxConstraints::Unbounded());
 				fixedSum += get<mainDirection>(size);
-				crossList[i] = get<crossDirection>(size);
+				max = Max(max, get<crossDirection>(size));
 			}
 		}
 
 		if (expandedIndex)
 		{
-			double r = (main - fixedSum) / sumRate;
+			const double r = (main - fixedSum) / sumRate;
 			for (const auto i : expandedIndex)
 			{
-				crossList[i] = get<crossDirection>(m_children[i], r * m_children[i]->getFlex());
+				max = Max(max, get<crossDirection>(m_children[i], r * m_children[i]->getFlex()));
 			}
 		}
 
-		double max = 0;
-		for (const auto& cross : crossList)
-		{
-			max = Max(max, cross);
-		}
-
 		return max;
 	}
 
@@ -663,16 +1081,33 @@ namespace BunchoUI
 		return (direction == UIDirection::x) ? child->getX(length) : child->getY(length);
 	}
 
+	template<UIDirection mainDirection, UIDirection crossDirection>
+	void BaseArrange<mainDirection, crossDirection>::onReconcile(UIElement& source)
+	{
+		const auto& arrange = static_cast<const BaseArrange&>(source);
+		if (m_mainAxis != arrange.m_mainAxis || m_crossAxis != arrange.m_crossAxis)
+		{
+			m_mainAxis = arrange.m_mainAxis;
+			m_crossAxis = arrange.m_crossAxis;
+			changeSize();
+		}
+
+		ChildrenContainer::onReconcile(source);
+	}
+
 	//-----------------------------------------------
 	//  Row
 	//-----------------------------------------------
 
 	inline Row::Row(const Parameter& para)
-		:BaseArrange<UIDirection::x, UIDirection::y>{ para.margine,para.width,para.height,para.flex,para.clickable,para.relative,para.mainAxis,para.crossAxis, para.children } {}
+		:BaseArrange<UIDirection::x, UIDirection::y>{ para.margine,para.width,para.height,para.flex,para.clickable,para.relative,para.mainAxis,para.crossAxis, para.children }
+	{
+		addClickListener(para.onClick);
+	}
 
 	inline std::shared_ptr<Row>Row::Create(const Parameter& para)
 	{
-		return std::make_shared<Row>(para);
+		return MakeNode<Row>(para);
 	}
 
 	//-----------------------------------------------
@@ -680,11 +1115,14 @@ namespace BunchoUI
 	//-----------------------------------------------
 
 	inline Column::Column(const Parameter& para)
-		:BaseArrange<UIDirection::y, UIDirection::x>{ para.margine,para.width,para.height,para.flex,para.clickable,para.relative,para.mainAxis,para.crossAxis, para.children } {}
+		:BaseArrange<UIDirection::y, UIDirection::x>{ para.margine,para.width,para.height,para.flex,para.clickable,para.relative,para.mainAxis,para.crossAxis, para.children }
+	{
+		addClickListener(para.onClick);
+	}
 
 	inline std::shared_ptr<Column>Column::Create(const Parameter& para)
 	{
-		return std::make_shared<Column>(para);
+		return MakeNode<Column>(para);
 	}
 
 	//-----------------------------------------------
@@ -692,12 +1130,14 @@ namespace BunchoUI
 	//-----------------------------------------------
 
 	inline StackUI::StackUI(const Parameter& para)
-		:ChildrenContainer{ para.margine,para.width,para.height,para.flex,para.clickable,para.relative,para.children } {
+		:ChildrenContainer{ para.margine,para.width,para.height,para.flex,para.clickable,para.relative,para.children }
+	{
+		addClickListener(para.onClick);
 	}
 
 	inline std::shared_ptr<StackUI>StackUI::Create(const Parameter& para)
 	{
-		return std::make_shared<StackUI>(para);
+		return MakeNode<StackUI>(para);
 	}
 
 	inline void StackUI::raiseToTop(const std::shared_ptr<UIElement>& child)
@@ -728,14 +1168,14 @@ namespace BunchoUI
 	inline SimpleDialog::SimpleDialog(const Parameter& para)
 		: ChildContainer{ {},none,none,0,false,Relative::Stretch(),para.child }
 		, m_transition{ Duration{para.fadeTime},Duration{para.fadeTime} }
-		, backgroundColor{ para.backgroundColor }
 		, erasable{ para.erasable }
-		, updateFunc{ para.updateFunc } {
+		, updateFunc{ para.updateFunc }
+		, m_backgroundColor{ para.backgroundColor } {
 	}
 
 	inline std::shared_ptr<SimpleDialog>SimpleDialog::Create(const Parameter& para)
 	{
-		return std::make_shared<SimpleDialog>(para);
+		return MakeNode<SimpleDialog>(para);
 	}
 
 	inline void SimpleDialog::close()noexcept
@@ -743,24 +1183,74 @@ namespace BunchoUI
 		m_close = true;
 	}
 
+	inline ColorF SimpleDialog::getBackgroundColor()const noexcept
+	{
+		return m_backgroundColor;
+	}
+
+	inline void SimpleDialog::setBackgroundColor(const ColorF& color)noexcept
+	{
+		if (m_backgroundColor == color)
+		{
+			return;
+		}
+
+		m_backgroundColor = color;
+		invalidate(Invalidation::Paint);
+	}
+
 	//-----------------------------------------------
 	//  RectPanel
 	//-----------------------------------------------
 
 	inline RectPanel::RectPanel(const Parameter& para)
 		: PanelBase{ para.padding,para.margine,para.width,para.height,para.flex,para.clickable,para.relative,para.child }
-		, r{ para.r }
-		, color{ para.color } {
+		, m_r{ para.r }
+		, m_color{ para.color }
+	{
+		addClickListener(para.onClick);
 	}
 
 	inline std::shared_ptr<RectPanel>RectPanel::Create(const Parameter& para)
 	{
-		return std::make_shared<RectPanel>(para);
+		return MakeNode<RectPanel>(para);
+	}
+
+	inline double RectPanel::getR()const noexcept
+	{
+		return m_r;
+	}
+
+	inline void RectPanel::setR(double r)noexcept
+	{
+		if (m_r == r)
+		{
+			return;
+		}
+
+		m_r = r;
+		invalidate(Invalidation::Paint | Invalidation::HitTest);
+	}
+
+	inline ColorF RectPanel::getColor()const noexcept
+	{
+		return m_color;
+	}
+
+	inline void RectPanel::setColor(const ColorF& color)noexcept
+	{
+		if (m_color == color)
+		{
+			return;
+		}
+
+		m_color = color;
+		invalidate(Invalidation::Paint);
 	}
 
 	inline RoundRect RectPanel::getRoundRect()const noexcept
 	{
-		return getRect().rounded(r);
+		return getRect().rounded(m_r);
 	}
 
 	//-----------------------------------------------
@@ -769,19 +1259,69 @@ namespace BunchoUI
 
 	inline SimpleButton::SimpleButton(const Parameter& para)
 		: PanelBase{ para.padding,para.margine,para.width,para.height,para.flex,para.clickable,para.relative,para.child }
-		, r{ para.r }
-		, color{ para.color }
-		, mouseOverColor{ para.mouseOverColor } {
+		, m_r{ para.r }
+		, m_color{ para.color }
+		, m_mouseOverColor{ para.mouseOverColor }
+	{
+		addClickListener(para.onClick);
 	}
 
 	inline std::shared_ptr<SimpleButton>SimpleButton::Create(const Parameter& para)
 	{
-		return std::make_shared<SimpleButton>(para);
+		return MakeNode<SimpleButton>(para);
+	}
+
+	inline double SimpleButton::getR()const noexcept
+	{
+		return m_r;
+	}
+
+	inline void SimpleButton::setR(double r)noexcept
+	{
+		if (m_r == r)
+		{
+			return;
+		}
+
+		m_r = r;
+		invalidate(Invalidation::Paint | Invalidation::HitTest);
+	}
+
+	inline ColorF SimpleButton::getColor()const noexcept
+	{
+		return m_color;
+	}
+
+	inline void SimpleButton::setColor(const ColorF& color)noexcept
+	{
+		if (m_color == color)
+		{
+			return;
+		}
+
+		m_color = color;
+		invalidate(Invalidation::Paint);
+	}
+
+	inline ColorF SimpleButton::getMouseOverColor()const noexcept
+	{
+		return m_mouseOverColor;
+	}
+
+	inline void SimpleButton::setMouseOverColor(const ColorF& color)noexcept
+	{
+		if (m_mouseOverColor == color)
+		{
+			return;
+		}
+
+		m_mouseOverColor = color;
+		invalidate(Invalidation::Paint);
 	}
 
 	inline RoundRect SimpleButton::getRoundRect()const noexcept
 	{
-		return getRect().rounded(r);
+		return getRect().rounded(m_r);
 	}
 
 	//-----------------------------------------------
@@ -790,14 +1330,14 @@ namespace BunchoUI
 
 	inline SimpleSlider::SimpleSlider(const Parameter& para)
 		: UIElement{ para.margine,para.width,para.height,para.flex,false,para.relative }
-		, value{ para.value }
-		, enabled{ para.enabled }
-		, color{ para.color } {
+		, m_value{ para.value }
+		, m_color{ para.color }
+		, m_enabled{ para.enabled } {
 	}
 
 	inline std::shared_ptr<SimpleSlider>SimpleSlider::Create(const Parameter& para)
 	{
-		return std::make_shared<SimpleSlider>(para);
+		return MakeNode<SimpleSlider>(para);
 	}
 
 	inline bool SimpleSlider::sliderReleased()const noexcept
@@ -805,6 +1345,54 @@ namespace BunchoUI
 		return m_sliderReleased;
 	}
 
+	inline double SimpleSlider::getValue()const noexcept
+	{
+		return m_value;
+	}
+
+	inline void SimpleSlider::setValue(double value)noexcept
+	{
+		if (m_value == value)
+		{
+			return;
+		}
+
+		m_value = value;
+		invalidate(Invalidation::Paint);
+	}
+
+	inline ColorF SimpleSlider::getColor()const noexcept
+	{
+		return m_color;
+	}
+
+	inline void SimpleSlider::setColor(const ColorF& color)noexcept
+	{
+		if (m_color == color)
+		{
+			return;
+		}
+
+		m_color = color;
+		invalidate(Invalidation::Paint);
+	}
+
+	inline bool SimpleSlider::isEnabled()const noexcept
+	{
+		return m_enabled;
+	}
+
+	inline void SimpleSlider::setEnabled(bool enabled)noexcept
+	{
+		if (m_enabled == enabled)
+		{
+			return;
+		}
+
+		m_enabled = enabled;
+		invalidate(Invalidation::Paint);
+	}
+
 	//-----------------------------------------------
 	//  SimpleScrollbar
 	//-----------------------------------------------
@@ -816,7 +1404,7 @@ namespace BunchoUI
 
 	inline std::shared_ptr<SimpleScrollbar>SimpleScrollbar::Create(const Parameter& para)
 	{
-		return std::make_shared<SimpleScrollbar>(para);
+		return MakeNode<SimpleScrollbar>(para);
 	}
 
 	inline bool SimpleScrollbar::isScroll()const noexcept
@@ -842,19 +1430,85 @@ namespace BunchoUI
 		return RoundRect{ rect.rightX() - ScrollbarWidth,rect.y + m_value * space,ScrollbarWidth,rect.h * getRate(),ScrollbarWidth / 2.0 };
 	}
 
+	inline RectF SimpleScrollbar::getVisibleRect()const noexcept
+	{
+		RectF view = getRect();
+		if (isScroll())
+		{
+			view.w -= ScrollbarWidth;
+		}
+		return view.movedBy(0, getScrollPos());
+	}
+
+	inline double SimpleScrollbar::getScrollPos()const noexcept
+	{
+		return isScroll() ? m_value * (m_childHeight - getRect().h) : 0.0;
+	}
+
+	//-----------------------------------------------
+	//  VirtualColumn
+	//-----------------------------------------------
+
+	inline VirtualColumn::VirtualColumn(const Parameter& para)
+		: UIElement{ para.margine,para.width,para.height,para.flex,false,para.relative }
+		, m_builder{ para.builder }
+		, m_updater{ para.updater }
+		, m_itemHeight{ para.itemHeight }
+		, m_estimatedItemHeight{ para.estimatedItemHeight }
+		, m_overscan{ para.overscan }
+		, m_crossAxis{ para.crossAxis }
+	{
+		setItemCount(para.itemCount);
+	}
+
+	inline std::shared_ptr<VirtualColumn>VirtualColumn::Create(const Parameter& para)
+	{
+		return MakeNode<VirtualColumn>(para);
+	}
+
+	inline size_t VirtualColumn::getItemCount()const noexcept
+	{
+		return m_itemCount;
+	}
+
+	inline double VirtualColumn::getExtent(size_t index)const noexcept
+	{
+		return m_itemHeight ? *m_itemHeight : m_extents[index];
+	}
+
+	inline double VirtualColumn::getTotalExtent()const noexcept
+	{
+		return m_itemHeight ? *m_itemHeight * m_itemCount : m_totalExtent;
+	}
+
+	//-----------------------------------------------
+	//  RepaintBoundary
+	//-----------------------------------------------
+
+	inline RepaintBoundary::RepaintBoundary(const Parameter& para)
+		: ChildContainer{ para.margine,para.width,para.height,para.flex,false,para.relative,para.child } {
+	}
+
+	inline std::shared_ptr<RepaintBoundary>RepaintBoundary::Create(const Parameter& para)
+	{
+		return MakeNode<RepaintBoundary>(para);
+	}
+
 	//-----------------------------------------------
 	//  RectUI
 	//-----------------------------------------------
 
 	inline RectUI::RectUI(const Parameter& para)
 		: UIElement{ para.margine,para.width,para.height,para.flex,para.clickable,para.relative }
-		, color{ para.color }
-		, m_size{ para.size } {
+		, m_size{ para.size }
+		, m_color{ para.color }
+	{
+		addClickListener(para.onClick);
 	}
 
 	inline std::shared_ptr<RectUI>RectUI::Create(const Parameter& para)
 	{
-		return std::make_shared<RectUI>(para);
+		return MakeNode<RectUI>(para);
 	}
 
 	inline SizeF RectUI::getSize()const noexcept
@@ -864,10 +1518,31 @@ namespace BunchoUI
 
 	inline void RectUI::setSize(const SizeF& size)noexcept
 	{
+		if (m_size == size)
+		{
+			return;
+		}
+
 		m_size = size;
 		changeSize();
 	}
 
+	inline ColorF RectUI::getColor()const noexcept
+	{
+		return m_color;
+	}
+
+	inline void RectUI::setColor(const ColorF& color)noexcept
+	{
+		if (m_color == color)
+		{
+			return;
+		}
+
+		m_color = color;
+		invalidate(Invalidation::Paint);
+	}
+
 	//-----------------------------------------------
 	//  TextUI
 	//-----------------------------------------------
@@ -876,14 +1551,17 @@ namespace BunchoUI
 		: UIElement{ para.margine,para.width,para.height,para.flex,para.clickable,para.relative }
 		, m_text{ para.text }
 		, m_font{ para.font }
-		, textStyle{ para.textStyle }
 		, m_fontSize{ para.fontSize }
-		, color{ para.color } {
+		, m_textStyle{ para.textStyle }
+		, m_color{ para.color }
+	{
+		shape();
+		addClickListener(para.onClick);
 	}
 
 	inline std::shared_ptr<TextUI>TextUI::Create(const Parameter& para)
 	{
-		return std::make_shared<TextUI>(para);
+		return MakeNode<TextUI>(para);
 	}
 
 	inline String TextUI::getText()const noexcept
@@ -893,7 +1571,13 @@ namespace BunchoUI
 
 	inline void TextUI::setText(StringView text)
 	{
+		if (m_text == text)
+		{
+			return;
+		}
+
 		m_text = text;
+		shape();
 		changeSize();
 	}
 
@@ -904,7 +1588,13 @@ namespace BunchoUI
 
 	inline void TextUI::setFont(const Font& font)
 	{
+		if (m_font.id() == font.id())
+		{
+			return;
+		}
+
 		m_font = font;
+		shape();
 		changeSize();
 	}
 
@@ -913,12 +1603,45 @@ namespace BunchoUI
 		return m_fontSize;
 	}
 
-	inline void TextUI::setFontSize(double fontSize)noexcept
+	inline void TextUI::setFontSize(double fontSize)
 	{
+		if (m_fontSize == fontSize)
+		{
+			return;
+		}
+
 		m_fontSize = fontSize;
+		updateRegion();
 		changeSize();
 	}
 
+	inline TextStyle TextUI::getTextStyle()const noexcept
+	{
+		return m_textStyle;
+	}
+
+	inline void TextUI::setTextStyle(const TextStyle& textStyle)noexcept
+	{
+		m_textStyle = textStyle;
+		invalidate(Invalidation::Paint);
+	}
+
+	inline ColorF TextUI::getColor()const noexcept
+	{
+		return m_color;
+	}
+
+	inline void TextUI::setColor(const ColorF& color)noexcept
+	{
+		if (m_color == color)
+		{
+			return;
+		}
+
+		m_color = color;
+		invalidate(Invalidation::Paint);
+	}
+
 	//-----------------------------------------------
 	//  TextUI
 	//-----------------------------------------------
@@ -926,12 +1649,14 @@ namespace BunchoUI
 	inline TextureUI::TextureUI(const Parameter& para)
 		: UIElement{ para.margine,para.width,para.height,para.flex,para.clickable,para.relative }
 		, m_texture{ para.texture }
-		, color{ para.color } {
+		, m_color{ para.color }
+	{
+		addClickListener(para.onClick);
 	}
 
 	inline std::shared_ptr<TextureUI>TextureUI::Create(const Parameter& para)
 	{
-		return std::make_shared<TextureUI>(para);
+		return MakeNode<TextureUI>(para);
 	}
 
 	inline TextureRegion TextureUI::getTexture()const noexcept
@@ -941,28 +1666,35 @@ namespace BunchoUI
 
 	inline void TextureUI::setTexture(const TextureRegion& texture)
 	{
+		if (m_texture.texture.id() == texture.texture.id() && m_texture.uvRect == texture.uvRect && m_texture.size == texture.size)
+		{
+			return;
+		}
+
 		m_texture = texture;
 		changeSize();
 	}
 
-	//-----------------------------------------------
-	//  UIManager
-	//-----------------------------------------------
-
-	inline UIManager::UIManager(const RectF& rect)
-		: m_rect{ rect } {
+	inline ColorF TextureUI::getColor()const noexcept
+	{
+		return m_color;
 	}
 
-	inline void UIManager::draw()const
+	inline void TextureUI::setColor(const ColorF& color)noexcept
 	{
-		if (m_stackUI->isChangeSize())
+		if (m_color == color)
 		{
-			m_stackUI->build(m_rect);
+			return;
 		}
 
-		m_stackUI->draw(m_rect);
+		m_color = color;
+		invalidate(Invalidation::Paint);
 	}
 
+	//-----------------------------------------------
+	//  UIManager
+	//-----------------------------------------------
+
 	inline void UIManager::setChildren(const Array<std::shared_ptr<UIElement>>& children)
 	{
 		m_stackUI->setChildren(children);
@@ -982,4 +1714,61 @@ namespace BunchoUI
 	{
 		return m_stackUI->getChildren();
 	}
+
+	inline void UIManager::setDrawReplay(bool enabled)noexcept
+	{
+		m_drawReplay = enabled;
+		m_drawList.clear();
+		m_previousDrawList.clear();
+	}
+
+	inline bool UIManager::isDrawReplay()const noexcept
+	{
+		return m_drawReplay;
+	}
+
+	inline void UIManager::setDamageRedraw(bool enabled)noexcept
+	{
+		m_damageRedraw = enabled;
+	}
+
+	inline bool UIManager::isDamageRedraw()const noexcept
+	{
+		return m_damageRedraw;
+	}
+
+	inline const Array<RectF>& UIManager::getDamageRects()const noexcept
+	{
+		return m_damageRects;
+	}
+
+	inline const FlatTree& UIManager::getFlatTree()const noexcept
+	{
+		return m_flatTree;
+	}
+
+	inline UIElement* UIManager::hitTest(const Vec2& pos)const noexcept
+	{
+		return m_flatTree.hitTest(pos);
+	}
+
+	inline UIManager::Transaction::Transaction()noexcept
+	{
+		UIElement::BeginTransaction();
+	}
+
+	inline UIManager::Transaction::~Transaction()
+	{
+		UIElement::CommitTransaction();
+	}
+
+	inline UIManager::Transaction UIManager::transaction()const noexcept
+	{
+		return Transaction{};
+	}
+
+	inline const FrameStats& UIManager::getFrameStats()const noexcept
+	{
+		return m_frameStats;
+	}
 }
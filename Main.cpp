@@ -29,7 +29,7 @@ auto ItemCountDisplay(int32 count,double size)
 	return TextUI::Create({ .text = U"所持：{}"_fmt(count),.fontSize = size });
 }
 
-auto ItemButton(const ItemData& item, bool canBuy)
+auto ItemButton(const ItemData& item, bool canBuy, const std::function<void()>& onClick)
 {
 	return SimpleButton::Create
 	({
@@ -61,7 +61,8 @@ auto ItemButton(const ItemData& item, bool canBuy)
 					}
 				}),
 			}
-		})
+		}),
+		.onClick = onClick
 	});
 }
 
@@ -120,7 +121,7 @@ auto PurchaseDialog(const ItemData& item, const std::function<void()>& onClicked
 		.child = TextUI::Create({.text = U"キャンセル",.color = Palette::White})
 	});
 
-	return SimpleDialog::Create({
+	auto dialog = SimpleDialog::Create({
 		.child = RectPanel::Create
 		({
 			.color = Palette::White,
@@ -146,20 +147,22 @@ auto PurchaseDialog(const ItemData& item, const std::function<void()>& onClicked
 					})
 				}
 			})
-		}),
-		.updateFunc = [=](SimpleDialog* ptr)
-		{
-			if (okButton->clicked())
-			{
-				ptr->close();
-				onClicked();
-			}
-			if (cancelButton->clicked())
-			{
-				ptr->close();
-			}
-		}
+		})
+	});
+
+	//ボタンはダイアログが持っているので、循環しないようにポインタで受け取る
+	okButton->addClickListener([ptr = dialog.get(), onClicked]
+	{
+		ptr->close();
+		onClicked();
+	});
+
+	cancelButton->addClickListener([ptr = dialog.get()]
+	{
+		ptr->close();
 	});
+
+	return dialog;
 }
 
 void Main()
@@ -199,13 +202,6 @@ void Main()
 
 	UIManager manager;
 
-	auto itemColumn = Column::Create({});
-
-	for (const auto& item : items)
-	{
-		itemColumn->addChild(ItemButton(item, item.amount <= playerCoins));
-	}
-
 	auto buyButton = SimpleButton::Create
 	({
 		.color = Palette::Orange,
@@ -239,6 +235,52 @@ void Main()
 		.child = ItemDetailsDisplay(items[selectIndex],buyButton,items[selectIndex].amount <= playerCoins),
 	});
 
+	const auto itemButton = [&](size_t i)
+	{
+		return ItemButton(items[i], items[i].amount <= playerCoins, [&, i]
+		{
+			selectIndex = i;
+			itemDetailsPanel->reconcileChild(ItemDetailsDisplay(items[i], buyButton, items[i].amount <= playerCoins));
+			buyButton->setClickable(items[i].amount <= playerCoins);
+		});
+	};
+
+	auto itemColumn = Column::Create({});
+
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		itemColumn->addChild(itemButton(i));
+	}
+
+	buyButton->addClickListener([&]
+	{
+		manager.addChild(PurchaseDialog(
+			items[selectIndex],
+			[&]
+			{
+				//まとめて変更するので、再配置の通知は最後に一度だけ行う
+				const auto transaction = manager.transaction();
+
+				playerCoins -= items[selectIndex].amount;
+				++items[selectIndex].count;
+
+				playerCoinsPanel->reconcileChild(PlayerCoinsDisplay(playerCoins));
+				itemDetailsPanel->reconcileChild(ItemDetailsDisplay(items[selectIndex], buyButton, items[selectIndex].amount <= playerCoins));
+
+				buyButton->setClickable(items[selectIndex].amount <= playerCoins);
+
+				for (size_t i = 0; i < items.size(); ++i)
+				{
+					const bool canBuy = items[i].amount <= playerCoins;
+					if (not canBuy || i == selectIndex)
+					{
+						itemColumn->reconcileChild(i, itemButton(i));
+					}
+				}
+			}
+		));
+	});
+
 	manager.setChildren
 	({
 		Row::Create
@@ -256,8 +298,9 @@ void Main()
 					.flex = 1.0,
 					.children
 					{
-						playerCoinsPanel,
-						itemDetailsPanel,
+						//変化の少ないパネルはテクスチャに描いておく
+						RepaintBoundary::Create({.relative = Relative::Stretch(),.child = playerCoinsPanel }),
+						RepaintBoundary::Create({.flex = 1.0,.relative = Relative::Stretch(),.child = itemDetailsPanel }),
 					}
 				}),
 			}
@@ -266,44 +309,9 @@ void Main()
 
 	while (System::Update())
 	{
+		//クリックなどは、登録した関数がupdateの中で呼ばれる
 		manager.update();
 
-		for (size_t i = 0; i < items.size(); ++i)
-		{
-			if (itemColumn->getChildren()[i]->clicked())
-			{
-				selectIndex = i;
-				itemDetailsPanel->setChild(ItemDetailsDisplay(items[i], buyButton, items[i].amount <= playerCoins));
-				buyButton->clickable = items[i].amount <= playerCoins;
-			}
-		}
-
-		if (buyButton->clicked())
-		{
-			manager.addChild(PurchaseDialog(
-				items[selectIndex],
-				[&]
-				{
-					playerCoins -= items[selectIndex].amount;
-					++items[selectIndex].count;
-
-					playerCoinsPanel->setChild(PlayerCoinsDisplay(playerCoins));
-					itemDetailsPanel->setChild(ItemDetailsDisplay(items[selectIndex], buyButton, items[selectIndex].amount <= playerCoins));
-
-					buyButton->clickable = items[selectIndex].amount <= playerCoins;
-
-					for (size_t i = 0; i < items.size(); ++i)
-					{
-						const bool canBuy = items[i].amount <= playerCoins;
-						if (not canBuy || i == selectIndex)
-						{
-							itemColumn->replaceChild(i, ItemButton(items[i], canBuy));
-						}
-					}
-				}
-			));
-		}
-
 		manager.draw();
 	}
 }
@@ -0,0 +1,41 @@
+﻿# include <Siv3D.hpp>
+# include "../BunchoUI.hpp"
+
+//ウィンドウを出さずに実行する
+SIV3D_SET(EngineOption::Renderer::Headless)
+
+using namespace BunchoUI;
+
+//UIManagerより長く生きる、木から取り除かれたUIを破棄しても、破棄されたFlatTreeに触らないことを確かめる
+//(触った場合はAddressSanitizerなどで検出される)
+void Main()
+{
+	const RectF area{ 0,0,400,300 };
+
+	//大きさを決めておくと、子供を変えたときにこのColumnの部分木だけを並べ直す(FlatTree::updateを通る)
+	auto removed = RectUI::Create({ .size = { 50,50 } });
+	const auto column = Column::Create({ .width = 200,.height = 200,.children{ RectUI::Create({.size = { 50,50 } }), removed } });
+
+	{
+		const auto manager = std::make_unique<UIManager>(area);
+		manager->addChild(column);
+		manager->update(area, MouseInput{});
+
+		//取り除いて並べ直す(FlatTreeからも外れる)
+		column->setChildren({ RectUI::Create({.size = { 50,50 } }) });
+		manager->update(area, MouseInput{});
+		manager->removeChild(column);
+	}
+
+	//UIManagerとFlatTreeが破棄された後に、取り除いたUIを破棄する
+	const std::weak_ptr<RectUI> weak = removed;
+	removed.reset();
+
+	if (not weak.expired())
+	{
+		Console << U"FAILED: the removed element is still alive";
+		std::exit(EXIT_FAILURE);
+	}
+
+	Console << U"FlatTreeRelease: OK";
+}
@@ -0,0 +1,62 @@
+﻿# include <Siv3D.hpp>
+# include "../BunchoUI.hpp"
+
+//ウィンドウを出さずに実行する
+SIV3D_SET(EngineOption::Renderer::Headless)
+
+using namespace BunchoUI;
+
+namespace
+{
+	/// @brief 条件を満たしていなければ、理由を表示して失敗の終了コードで終わる
+	void Check(bool condition, const String& message)
+	{
+		if (not condition)
+		{
+			Console << U"FAILED: " << message;
+			std::exit(EXIT_FAILURE);
+		}
+	}
+}
+
+void Main()
+{
+	const RectF area{ 0,0,400,300 };
+	const Vec2 center = area.center();
+
+	UIManager manager{ area };
+	manager.update(area, MouseInput{});
+
+	size_t clicks = 0;
+	const auto button = SimpleButton::Create({ .width = 100,.height = 40,.relative = Relative::Center(),.onClick = [&] { ++clicks; } });
+
+	//追加したフレームのupdateで、押して離す(レイアウトはupdateの最初に行われる)
+	manager.addChild(button);
+	manager.update(area, MouseInput{ .pos = center,.leftDown = true,.leftUp = true });
+	Check(clicks == 1, U"a button added in the same frame was not clicked");
+
+	//押したフレームと離したフレームが違っても、クリックになる
+	manager.update(area, MouseInput{ .pos = center,.leftDown = true });
+	manager.update(area, MouseInput{ .pos = center,.leftUp = true });
+	Check(clicks == 2, U"a press and release over two frames was not a click");
+
+	//ボタンの外で離したら、クリックにならない
+	manager.update(area, MouseInput{ .pos = center,.leftDown = true });
+	manager.update(area, MouseInput{ .pos = Vec2{ 10,10 },.leftUp = true });
+	Check(clicks == 2, U"releasing outside the button was a click");
+
+	//ボタンの状態を直接読むUI(スライダーのつまみ)も、渡した入力で動く
+	UIManager sliderManager{ area };
+	const auto slider = SimpleSlider::Create({ .relative = Relative::Center() });
+	sliderManager.addChild(slider);
+	sliderManager.update(area, MouseInput{ .pos = center,.leftDown = true,.leftPressed = true });
+	sliderManager.update(area, MouseInput{ .pos = Vec2{ area.w,center.y },.leftPressed = true });
+	sliderManager.update(area, MouseInput{ .pos = Vec2{ area.w,center.y },.leftUp = true });
+	Check(slider->getValue() == 1.0, U"a slider was not dragged by the given input");
+
+	//離した後は、つまみを動かさない
+	sliderManager.update(area, MouseInput{ .pos = Vec2{ 0,center.y } });
+	Check(slider->getValue() == 1.0, U"a slider kept following the cursor after the release");
+
+	Console << U"SameFrameClick: OK";
+}